@@ -0,0 +1,344 @@
+#include "generators.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "search_server.h"
+#include "string_processing.h"
+
+#include <chrono>
+#include <execution>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Benchmarks of the SearchServer operations over a sweep of corpus size, vocabulary size
+// and query length. Every configuration is generated from BENCHMARK_SEED, so runs on one
+// machine are comparable. Results are written as JSON to stdout or to the file given as
+// the last argument; --quick runs a small sweep. Every configuration also reports how the
+// top documents compare with an exact TF-IDF ranking computed from the forward index,
+// which measures the loss of SEARCH_SERVER_IMPACT_BITS quantization.
+
+const uint32_t BENCHMARK_SEED = 42;
+const int MAX_WORD_LENGTH = 10;
+const int DOCUMENT_WORD_COUNT = 70;
+const int QUERY_COUNT = 200;
+const double QUERY_MINUS_PROB = 0.1;
+// every this many documents one repeats an earlier one, for RemoveDuplicates
+const int DUPLICATE_PERIOD = 10;
+// read-only benchmarks report the fastest of this many runs
+const int REPETITION_COUNT = 3;
+
+struct BenchmarkConfig {
+    int document_count;
+    int vocabulary_size;
+    int query_word_count;
+};
+
+struct BenchmarkResult {
+    string name;
+    BenchmarkConfig config;
+    int64_t operation_count;
+    chrono::nanoseconds total_time;
+    // sum of result sizes, so that the measured work cannot be optimized away
+    int64_t checksum;
+};
+
+struct QualityResult {
+    BenchmarkConfig config;
+    int query_count;
+    // share of the exact top documents that the search returns, averaged over the queries
+    double mean_recall;
+    // share of the queries answered with the exact ranking
+    double identical_ratio;
+    // over the documents returned by both
+    double max_relative_error;
+};
+
+template <typename Operation>
+chrono::nanoseconds MeasureFastest(int repetition_count, Operation operation) {
+    chrono::nanoseconds fastest = chrono::nanoseconds::max();
+    for (int i = 0; i < repetition_count; ++i) {
+        const auto start_time = chrono::steady_clock::now();
+        operation();
+        fastest = min(fastest, chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start_time));
+    }
+    return fastest;
+}
+
+vector<string> GenerateCorpus(mt19937& generator, const vector<string>& dictionary, int document_count) {
+    vector<string> documents = GenerateQueries(generator, dictionary, document_count, DOCUMENT_WORD_COUNT);
+    for (int i = DUPLICATE_PERIOD; i < document_count; i += DUPLICATE_PERIOD) {
+        documents[i] = documents[uniform_int_distribution(0, i - 1)(generator)];
+    }
+    return documents;
+}
+
+vector<int> GenerateRatings(mt19937& generator) {
+    vector<int> ratings(3);
+    for (int& rating : ratings) {
+        rating = uniform_int_distribution(-10, 10)(generator);
+    }
+    return ratings;
+}
+
+void AddDocuments(SearchServer& search_server, mt19937& generator, const vector<string>& documents) {
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, GenerateRatings(generator));
+    }
+}
+
+template <typename ExecutionPolicy, typename DocumentSelector>
+BenchmarkResult BenchmarkFindTopDocuments(string name, const BenchmarkConfig& config, const SearchServer& search_server,
+                                          const vector<string>& queries, ExecutionPolicy& policy, DocumentSelector selector) {
+    int64_t checksum = 0;
+    const auto total_time = MeasureFastest(REPETITION_COUNT, [&] {
+        checksum = 0;
+        for (const string& query : queries) {
+            checksum += search_server.FindTopDocuments(policy, query, selector).size();
+        }
+    });
+    return {move(name), config, static_cast<int64_t>(queries.size()), total_time, checksum};
+}
+
+template <typename ExecutionPolicy>
+BenchmarkResult BenchmarkMatchDocument(string name, const BenchmarkConfig& config, const SearchServer& search_server,
+                                       const vector<string>& queries, ExecutionPolicy& policy) {
+    // every query against a fixed spread of documents
+    const int document_step = max(1, config.document_count / 16);
+    int64_t operation_count = 0;
+    int64_t checksum = 0;
+    const auto total_time = MeasureFastest(REPETITION_COUNT, [&] {
+        operation_count = 0;
+        checksum = 0;
+        for (const string& query : queries) {
+            for (int id = 0; id < config.document_count; id += document_step) {
+                checksum += get<0>(search_server.MatchDocument(policy, query, id)).size();
+                ++operation_count;
+            }
+        }
+    });
+    return {move(name), config, operation_count, total_time, checksum};
+}
+
+// TF-IDF relevance of every document matching query, computed with the exact term
+// frequencies of the forward index
+map<int, double> ComputeExactRelevance(const SearchServer& search_server, const map<string, map<int, double>>& word_to_document_freqs,
+                                       const string& stop_word, const string& query) {
+    set<string> plus_words;
+    set<string> minus_words;
+    for (const string& word : SplitIntoWords(query)) {
+        if (word[0] == '-') {
+            minus_words.insert(word.substr(1));
+        } else {
+            plus_words.insert(word);
+        }
+    }
+
+    const TfIdfScoring scoring;
+    map<int, double> document_to_relevance;
+    for (const string& word : plus_words) {
+        const auto postings = word_to_document_freqs.find(word);
+        if (word == stop_word || postings == word_to_document_freqs.end()) {
+            continue;
+        }
+        const double inverse_document_freq = scoring.InverseDocumentFreq(search_server.GetDocumentCount(), postings->second.size());
+        for (const auto [document_id, term_freq] : postings->second) {
+            document_to_relevance[document_id] += scoring.TermScore(term_freq, inverse_document_freq, 0, 0.0);
+        }
+    }
+    for (const string& word : minus_words) {
+        const auto postings = word_to_document_freqs.find(word);
+        if (word == stop_word || postings == word_to_document_freqs.end()) {
+            continue;
+        }
+        for (const auto [document_id, _] : postings->second) {
+            document_to_relevance.erase(document_id);
+        }
+    }
+    return document_to_relevance;
+}
+
+// Documents are compared by exact relevance only, as ties are common (the corpus has
+// duplicates) and any order of tied documents is a correct answer.
+QualityResult MeasureRankingQuality(const BenchmarkConfig& config, const SearchServer& search_server,
+                                    const string& stop_word, const vector<string>& queries) {
+    map<string, map<int, double>> word_to_document_freqs;
+    for (const int document_id : search_server) {
+        for (const auto [word, term_freq] : search_server.GetWordFrequencies(document_id)) {
+            word_to_document_freqs[string(word)][document_id] = term_freq;
+        }
+    }
+
+    double recall_sum = 0.0;
+    int identical_count = 0;
+    double max_relative_error = 0.0;
+    for (const string& query : queries) {
+        const map<int, double> exact_relevance = ComputeExactRelevance(search_server, word_to_document_freqs, stop_word, query);
+        vector<double> top_relevances;
+        for (const auto [document_id, relevance] : exact_relevance) {
+            top_relevances.push_back(relevance);
+        }
+        const size_t top_count = min<size_t>(top_relevances.size(), MAX_RESULT_DOCUMENT_COUNT);
+        partial_sort(top_relevances.begin(), top_relevances.begin() + top_count, top_relevances.end(), greater<>());
+        top_relevances.resize(top_count);
+
+        const vector<Document> documents = search_server.FindTopDocuments(query);
+        bool identical = documents.size() == top_count;
+        int correct_count = 0;
+        for (size_t i = 0; i < documents.size(); ++i) {
+            const double relevance = exact_relevance.at(documents[i].id);
+            if (relevance > 0.0) {
+                max_relative_error = max(max_relative_error, abs(documents[i].relevance - relevance) / relevance);
+            }
+            // the document belongs to some exact top
+            correct_count += relevance >= top_relevances.back() - RELEVANCE_COMPARISON_ERR;
+            identical = identical && abs(relevance - top_relevances[i]) < RELEVANCE_COMPARISON_ERR;
+        }
+        recall_sum += top_count == 0 ? 1.0 : static_cast<double>(correct_count) / top_count;
+        identical_count += identical;
+    }
+    const int query_count = static_cast<int>(queries.size());
+    return {config, query_count, recall_sum / query_count, static_cast<double>(identical_count) / query_count, max_relative_error};
+}
+
+vector<BenchmarkResult> RunBenchmarks(const BenchmarkConfig& config, vector<QualityResult>& quality_results) {
+    mt19937 generator(BENCHMARK_SEED);
+    const vector<string> dictionary = GenerateDictionary(generator, config.vocabulary_size, MAX_WORD_LENGTH);
+    const vector<string> documents = GenerateCorpus(generator, dictionary, config.document_count);
+    vector<string> queries;
+    queries.reserve(QUERY_COUNT);
+    for (int i = 0; i < QUERY_COUNT; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, config.query_word_count, QUERY_MINUS_PROB));
+    }
+
+    vector<BenchmarkResult> results;
+    SearchServer search_server(dictionary[0]);
+    {
+        const auto start_time = chrono::steady_clock::now();
+        AddDocuments(search_server, generator, documents);
+        const auto total_time = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start_time);
+        results.push_back({"AddDocument"s, config, config.document_count, total_time, search_server.GetDocumentCount()});
+    }
+    quality_results.push_back(MeasureRankingQuality(config, search_server, dictionary[0], queries));
+
+    const auto even_ids = [](int document_id, DocumentStatus, int) {
+        return document_id % 2 == 0;
+    };
+    results.push_back(BenchmarkFindTopDocuments("FindTopDocuments/seq/status"s, config, search_server, queries, execution::seq, DocumentStatus::ACTUAL));
+    results.push_back(BenchmarkFindTopDocuments("FindTopDocuments/par/status"s, config, search_server, queries, execution::par, DocumentStatus::ACTUAL));
+    results.push_back(BenchmarkFindTopDocuments("FindTopDocuments/seq/predicate"s, config, search_server, queries, execution::seq, even_ids));
+    results.push_back(BenchmarkFindTopDocuments("FindTopDocuments/par/predicate"s, config, search_server, queries, execution::par, even_ids));
+    results.push_back(BenchmarkMatchDocument("MatchDocument/seq"s, config, search_server, queries, execution::seq));
+    results.push_back(BenchmarkMatchDocument("MatchDocument/par"s, config, search_server, queries, execution::par));
+
+    {
+        int64_t checksum = 0;
+        const auto total_time = MeasureFastest(REPETITION_COUNT, [&] {
+            checksum = 0;
+            for (const auto& documents_list : ProcessQueries(search_server, queries)) {
+                checksum += documents_list.size();
+            }
+        });
+        results.push_back({"ProcessQueries"s, config, static_cast<int64_t>(queries.size()), total_time, checksum});
+    }
+
+    // the mutating benchmarks run once, in this order, on the same server
+    {
+        // RemoveDuplicates without its report on stdout
+        const auto start_time = chrono::steady_clock::now();
+        for (const int document_id : FindDuplicates(search_server)) {
+            search_server.RemoveDocument(document_id);
+        }
+        const auto total_time = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start_time);
+        results.push_back({"RemoveDuplicates"s, config, config.document_count, total_time, search_server.GetDocumentCount()});
+    }
+    {
+        const vector<int> document_ids(search_server.begin(), search_server.end());
+        const auto start_time = chrono::steady_clock::now();
+        for (const int document_id : document_ids) {
+            search_server.RemoveDocument(document_id);
+        }
+        const auto total_time = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start_time);
+        results.push_back({"RemoveDocument"s, config, static_cast<int64_t>(document_ids.size()), total_time, search_server.GetDocumentCount()});
+    }
+    return results;
+}
+
+void PrintJson(ostream& out, const vector<BenchmarkResult>& results, const vector<QualityResult>& quality_results) {
+    out << "{\n  \"seed\": "s << BENCHMARK_SEED << ",\n  \"impact_bits\": "s << SEARCH_SERVER_IMPACT_BITS
+        << ",\n  \"benchmarks\": [\n"s;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& result = results[i];
+        const double ns_per_operation = result.operation_count == 0
+                                        ? 0.0 : static_cast<double>(result.total_time.count()) / result.operation_count;
+        out << "    {\"name\": \""s << result.name << "\", "s
+            << "\"document_count\": "s << result.config.document_count << ", "s
+            << "\"vocabulary_size\": "s << result.config.vocabulary_size << ", "s
+            << "\"query_word_count\": "s << result.config.query_word_count << ", "s
+            << "\"operations\": "s << result.operation_count << ", "s
+            << "\"total_ns\": "s << result.total_time.count() << ", "s
+            << "\"ns_per_operation\": "s << ns_per_operation << ", "s
+            << "\"checksum\": "s << result.checksum << '}'
+            << (i + 1 < results.size() ? ",\n"s : "\n"s);
+    }
+    out << "  ],\n  \"ranking_quality\": [\n"s;
+    for (size_t i = 0; i < quality_results.size(); ++i) {
+        const QualityResult& result = quality_results[i];
+        out << "    {\"document_count\": "s << result.config.document_count << ", "s
+            << "\"vocabulary_size\": "s << result.config.vocabulary_size << ", "s
+            << "\"query_word_count\": "s << result.config.query_word_count << ", "s
+            << "\"queries\": "s << result.query_count << ", "s
+            << "\"mean_recall\": "s << result.mean_recall << ", "s
+            << "\"identical_ratio\": "s << result.identical_ratio << ", "s
+            << "\"max_relative_error\": "s << result.max_relative_error << '}'
+            << (i + 1 < quality_results.size() ? ",\n"s : "\n"s);
+    }
+    out << "  ]\n}\n"s;
+}
+
+int main(int argc, char* argv[]) {
+    bool quick = false;
+    string output_file;
+    for (int i = 1; i < argc; ++i) {
+        const string argument = argv[i];
+        if (argument == "--quick"s) {
+            quick = true;
+        } else {
+            output_file = argument;
+        }
+    }
+
+    const vector<int> document_counts = quick ? vector{1'000} : vector{1'000, 10'000};
+    const vector<int> vocabulary_sizes = quick ? vector{1'000} : vector{1'000, 10'000};
+    const vector<int> query_word_counts = quick ? vector{3} : vector{3, 10, 30};
+
+    vector<BenchmarkResult> results;
+    vector<QualityResult> quality_results;
+    for (const int document_count : document_counts) {
+        for (const int vocabulary_size : vocabulary_sizes) {
+            for (const int query_word_count : query_word_counts) {
+                cerr << "documents = "s << document_count << ", vocabulary = "s << vocabulary_size
+                     << ", query words = "s << query_word_count << endl;
+                for (BenchmarkResult& result : RunBenchmarks({document_count, vocabulary_size, query_word_count}, quality_results)) {
+                    results.push_back(move(result));
+                }
+            }
+        }
+    }
+
+    if (output_file.empty()) {
+        PrintJson(cout, results, quality_results);
+    } else {
+        ofstream out(output_file);
+        if (!out) {
+            cerr << "Cannot open "s << output_file << endl;
+            return 1;
+        }
+        PrintJson(out, results, quality_results);
+    }
+}
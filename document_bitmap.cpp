@@ -0,0 +1,30 @@
+#include "document_bitmap.h"
+
+using namespace std;
+
+void DocumentBitmap::Set(uint32_t ordinal) {
+    const size_t word_index = ordinal / 64;
+    if (word_index >= words_.size()) {
+        words_.resize(word_index + 1);
+    }
+    const uint64_t bit = uint64_t{1} << (ordinal % 64);
+    if (!(words_[word_index] & bit)) {
+        words_[word_index] |= bit;
+        ++count_;
+    }
+}
+
+void DocumentBitmap::Reset(uint32_t ordinal) {
+    if (Test(ordinal)) {
+        words_[ordinal / 64] &= ~(uint64_t{1} << (ordinal % 64));
+        --count_;
+    }
+}
+
+size_t DocumentBitmap::Count() const {
+    return count_;
+}
+
+size_t DocumentBitmap::GetCapacityBytes() const {
+    return words_.capacity() * sizeof(uint64_t);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Set of documents stored as one bit per internal ordinal, up to the largest ordinal ever
+// set. Ordinals are dense and reused, so the size follows the document count rather than
+// the id values.
+class DocumentBitmap {
+public:
+    void Set(uint32_t ordinal);
+    void Reset(uint32_t ordinal);
+
+    bool Test(uint32_t ordinal) const {
+        const size_t word_index = ordinal / 64;
+        return word_index < words_.size() && (words_[word_index] >> (ordinal % 64) & 1);
+    }
+
+    size_t Count() const;
+    size_t GetCapacityBytes() const;
+
+private:
+    std::vector<uint64_t> words_;
+    size_t count_ = 0;
+};
@@ -0,0 +1,46 @@
+#include "document_fingerprint.h"
+
+#include <functional>
+#include <tuple>
+
+using namespace std;
+
+uint64_t MixBits(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
+
+namespace {
+
+uint64_t HashFnv1a(string_view term) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char c : term) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+}
+
+void TermSetFingerprint::AddTerm(string_view term) {
+    // the halves are summed rather than xor-ed so that a repeated term cannot cancel out
+    high += MixBits(hash<string_view>{}(term));
+    low += MixBits(HashFnv1a(term));
+}
+
+bool operator==(const TermSetFingerprint& lhs, const TermSetFingerprint& rhs) {
+    return lhs.high == rhs.high && lhs.low == rhs.low;
+}
+
+bool operator!=(const TermSetFingerprint& lhs, const TermSetFingerprint& rhs) {
+    return !(lhs == rhs);
+}
+
+bool operator<(const TermSetFingerprint& lhs, const TermSetFingerprint& rhs) {
+    return tie(lhs.high, lhs.low) < tie(rhs.high, rhs.low);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// splitmix64 finalizer, a cheap bijective scrambling of 64-bit hashes
+uint64_t MixBits(uint64_t value);
+
+// 128-bit fingerprint of a set of terms. The two halves come from unrelated hash
+// functions and the per-term hashes are summed, so the fingerprint does not depend
+// on the order of the terms. Every term must be passed exactly once.
+struct TermSetFingerprint {
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    void AddTerm(std::string_view term);
+};
+
+bool operator==(const TermSetFingerprint& lhs, const TermSetFingerprint& rhs);
+bool operator!=(const TermSetFingerprint& lhs, const TermSetFingerprint& rhs);
+bool operator<(const TermSetFingerprint& lhs, const TermSetFingerprint& rhs);
+
+struct TermSetFingerprintHasher {
+    size_t operator()(const TermSetFingerprint& fingerprint) const {
+        return static_cast<size_t>(fingerprint.high ^ fingerprint.low);
+    }
+};
+
+template <typename TermRange>
+TermSetFingerprint ComputeTermSetFingerprint(const TermRange& terms) {
+    TermSetFingerprint fingerprint;
+    for (const std::string_view term : terms) {
+        fingerprint.AddTerm(term);
+    }
+    return fingerprint;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <random>
+#include <string>
+#include <vector>
+
+// Synthetic words, documents and queries for benchmarks. Results depend only on the
+// state of the generator, so a fixed seed reproduces them.
+
+std::string GenerateWord(std::mt19937& generator, int max_length);
+std::vector<std::string> GenerateDictionary(std::mt19937& generator, int word_count, int max_length);
+// word_count words of dictionary, each prefixed with '-' with probability minus_prob
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary, int word_count, double minus_prob = 0);
+std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary, int query_count, int max_word_count);
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+// Storage of the term frequency of a posting, selected at build time by
+// SEARCH_SERVER_IMPACT_BITS: 0 keeps the exact double, 8 or 16 store a code of that many
+// bits. A term frequency lies in (0, 1], so codes are spaced evenly in log2 over
+// [-IMPACT_LOG2_RANGE, 0], which bounds the relative error instead of the absolute one:
+// about 2.8% with 8 bits and 0.011% with 16. Smaller frequencies, i.e. a word occurring
+// once in over a million words, round up to the smallest code. The forward index keeps
+// exact frequencies whatever the setting.
+
+#ifndef SEARCH_SERVER_IMPACT_BITS
+#define SEARCH_SERVER_IMPACT_BITS 0
+#endif
+
+const double IMPACT_LOG2_RANGE = 20.0;
+
+template <int Bits>
+struct TermFreqQuantizer {
+    static_assert(Bits == 8 || Bits == 16, "SEARCH_SERVER_IMPACT_BITS must be 0, 8 or 16");
+
+    using Code = std::conditional_t<Bits == 8, uint8_t, uint16_t>;
+
+    static constexpr int max_code = (1 << Bits) - 1;
+
+    static Code Encode(double term_freq) {
+        const double code = std::round(max_code + std::log2(term_freq) * max_code / IMPACT_LOG2_RANGE);
+        return static_cast<Code>(code < 0.0 ? 0.0 : code > max_code ? max_code : code);
+    }
+
+    static double Decode(Code code) {
+        if constexpr (Bits == 8) {
+            // 256 entries fit in a few cache lines
+            static const std::array<double, max_code + 1> term_freqs = [] {
+                std::array<double, max_code + 1> result{};
+                for (int i = 0; i <= max_code; ++i) {
+                    result[i] = Compute(static_cast<Code>(i));
+                }
+                return result;
+            }();
+            return term_freqs[code];
+        } else {
+            return Compute(code);
+        }
+    }
+
+private:
+    static double Compute(Code code) {
+        return std::exp2((static_cast<int>(code) - max_code) * IMPACT_LOG2_RANGE / max_code);
+    }
+};
+
+template <>
+struct TermFreqQuantizer<0> {
+    using Code = double;
+
+    static Code Encode(double term_freq) {
+        return term_freq;
+    }
+
+    static double Decode(Code code) {
+        return code;
+    }
+};
+
+using TermFreqCodec = TermFreqQuantizer<SEARCH_SERVER_IMPACT_BITS>;
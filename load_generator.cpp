@@ -0,0 +1,301 @@
+#include "generators.h"
+#include "request_stats.h"
+#include "search_server.h"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Load test of SearchServer. Client threads replay a query log, or generated queries,
+// either closed-loop (every client sends its next query once the previous one returns) or
+// open-loop (queries arrive at a fixed total rate whether or not the server keeps up).
+// Open-loop latency is measured from the scheduled arrival, so queueing behind a slow
+// query counts against the tail. Optionally a mutator thread adds and removes documents
+// concurrently; searches hold a shared lock and mutations an exclusive one. Queries and
+// documents the server rejects are counted as errors rather than ending the run.
+//
+// Options:
+//   --corpus FILE         one document per line; generated when absent
+//   --queries FILE        one query per line; generated when absent
+//   --documents N         generated corpus size (10000)
+//   --vocabulary N        generated dictionary size (10000)
+//   --query-words N       words per generated query (5)
+//   --threads N           client threads (4)
+//   --mode open|closed    arrival model (closed)
+//   --rate QPS            total arrival rate of the open loop (1000)
+//   --duration SECONDS    length of the run (10)
+//   --mutation-rate OPS   AddDocument plus RemoveDocument calls per second (0)
+//   --seed N              seed of the generated data (42)
+
+struct LoadOptions {
+    string corpus_file;
+    string queries_file;
+    int document_count = 10'000;
+    int vocabulary_size = 10'000;
+    int query_word_count = 5;
+    int thread_count = 4;
+    bool open_loop = false;
+    double rate = 1000.0;
+    double duration_seconds = 10.0;
+    double mutation_rate = 0.0;
+    uint32_t seed = 42;
+};
+
+struct ClientStats {
+    LatencyHistogram latencies;
+    uint64_t query_count = 0;
+    uint64_t empty_count = 0;
+    // queries the server rejected as invalid
+    uint64_t error_count = 0;
+    // open loop only: arrivals that were already overdue when the client got to them
+    uint64_t late_count = 0;
+};
+
+LoadOptions ParseOptions(int argc, char* argv[]) {
+    LoadOptions options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const string name = argv[i];
+        const string value = argv[i + 1];
+        if (name == "--corpus"s) {
+            options.corpus_file = value;
+        } else if (name == "--queries"s) {
+            options.queries_file = value;
+        } else if (name == "--documents"s) {
+            options.document_count = stoi(value);
+        } else if (name == "--vocabulary"s) {
+            options.vocabulary_size = stoi(value);
+        } else if (name == "--query-words"s) {
+            options.query_word_count = stoi(value);
+        } else if (name == "--threads"s) {
+            options.thread_count = stoi(value);
+        } else if (name == "--mode"s) {
+            if (value != "open"s && value != "closed"s) {
+                throw invalid_argument("Mode must be open or closed"s);
+            }
+            options.open_loop = value == "open"s;
+        } else if (name == "--rate"s) {
+            options.rate = stod(value);
+        } else if (name == "--duration"s) {
+            options.duration_seconds = stod(value);
+        } else if (name == "--mutation-rate"s) {
+            options.mutation_rate = stod(value);
+        } else if (name == "--seed"s) {
+            options.seed = static_cast<uint32_t>(stoul(value));
+        } else {
+            throw invalid_argument("Unknown option "s + name);
+        }
+    }
+    if (argc % 2 == 0) {
+        throw invalid_argument("Option "s + argv[argc - 1] + " has no value"s);
+    }
+    if (options.thread_count <= 0 || options.rate <= 0 || options.duration_seconds <= 0) {
+        throw invalid_argument("Threads, rate and duration must be positive"s);
+    }
+    return options;
+}
+
+vector<string> ReadLines(const string& file_name) {
+    ifstream input(file_name);
+    if (!input) {
+        throw runtime_error("Cannot open "s + file_name);
+    }
+    vector<string> lines;
+    for (string line; getline(input, line);) {
+        // files with CRLF line endings
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty()) {
+            lines.push_back(move(line));
+        }
+    }
+    return lines;
+}
+
+void RunClient(const SearchServer& search_server, shared_mutex& index_mutex, const vector<string>& queries,
+               const LoadOptions& options, int client_index, chrono::steady_clock::time_point end_time, ClientStats& stats) {
+    using Clock = chrono::steady_clock;
+
+    // clients start at different offsets of the query log
+    size_t query_index = queries.size() * client_index / options.thread_count;
+    const auto interval = chrono::duration_cast<Clock::duration>(
+            chrono::duration<double>(options.thread_count / options.rate));
+    // clients of the open loop are staggered evenly over one interval
+    Clock::time_point arrival_time = Clock::now() + interval * client_index / options.thread_count;
+
+    while (true) {
+        Clock::time_point start_time = Clock::now();
+        if (options.open_loop) {
+            if (arrival_time >= end_time) {
+                break;
+            }
+            if (arrival_time > start_time) {
+                this_thread::sleep_until(arrival_time);
+            } else {
+                ++stats.late_count;
+            }
+            start_time = arrival_time;
+            arrival_time += interval;
+        } else if (start_time >= end_time) {
+            break;
+        }
+
+        size_t result_size = 0;
+        bool is_valid = true;
+        try {
+            shared_lock lock(index_mutex);
+            result_size = search_server.FindTopDocuments(queries[query_index]).size();
+        } catch (const invalid_argument&) {
+            is_valid = false;
+        }
+        stats.latencies.Record(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start_time));
+        ++stats.query_count;
+        if (!is_valid) {
+            ++stats.error_count;
+        } else if (result_size == 0) {
+            ++stats.empty_count;
+        }
+        query_index = (query_index + 1) % queries.size();
+    }
+}
+
+struct MutatorStats {
+    uint64_t mutation_count = 0;
+    // corpus lines the server rejected
+    uint64_t error_count = 0;
+};
+
+// Alternates between adding a document from the corpus and removing the oldest added one.
+MutatorStats RunMutator(SearchServer& search_server, shared_mutex& index_mutex, const vector<string>& corpus,
+                        const LoadOptions& options, chrono::steady_clock::time_point end_time) {
+    using Clock = chrono::steady_clock;
+
+    const auto interval = chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / options.mutation_rate));
+    int next_id = static_cast<int>(corpus.size());
+    deque<int> added_ids;
+    MutatorStats stats;
+    for (Clock::time_point next_time = Clock::now(); next_time < end_time; next_time += interval) {
+        this_thread::sleep_until(next_time);
+        unique_lock lock(index_mutex);
+        if (stats.mutation_count % 2 == 0) {
+            const int document_id = next_id++;
+            try {
+                search_server.AddDocument(document_id, corpus[document_id % corpus.size()], DocumentStatus::ACTUAL, {1});
+            } catch (const invalid_argument&) {
+                ++stats.error_count;
+                continue;
+            }
+            added_ids.push_back(document_id);
+        } else {
+            search_server.RemoveDocument(added_ids.front());
+            added_ids.pop_front();
+        }
+        ++stats.mutation_count;
+    }
+    return stats;
+}
+
+int main(int argc, char* argv[]) {
+    LoadOptions options;
+    try {
+        options = ParseOptions(argc, argv);
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    mt19937 generator(options.seed);
+    const vector<string> dictionary = GenerateDictionary(generator, options.vocabulary_size, 10);
+    vector<string> corpus;
+    vector<string> queries;
+    try {
+        corpus = options.corpus_file.empty()
+                 ? GenerateQueries(generator, dictionary, options.document_count, 70)
+                 : ReadLines(options.corpus_file);
+        if (options.queries_file.empty()) {
+            for (int i = 0; i < 10'000; ++i) {
+                queries.push_back(GenerateQuery(generator, dictionary, options.query_word_count, 0.1));
+            }
+        } else {
+            queries = ReadLines(options.queries_file);
+        }
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    if (corpus.empty() || queries.empty()) {
+        cerr << "Corpus and queries must not be empty"s << endl;
+        return 1;
+    }
+
+    SearchServer search_server("and with"s);
+    uint64_t rejected_document_count = 0;
+    for (int id = 0; id < static_cast<int>(corpus.size()); ++id) {
+        try {
+            search_server.AddDocument(id, corpus[id], DocumentStatus::ACTUAL, {1});
+        } catch (const invalid_argument&) {
+            ++rejected_document_count;
+        }
+    }
+    cerr << "Indexed "s << search_server.GetDocumentCount() << " documents, rejected "s << rejected_document_count
+         << ", replaying "s << queries.size() << " queries"s << endl;
+
+    shared_mutex index_mutex;
+    vector<ClientStats> client_stats(options.thread_count);
+    const auto start_time = chrono::steady_clock::now();
+    const auto end_time = start_time + chrono::duration_cast<chrono::steady_clock::duration>(
+            chrono::duration<double>(options.duration_seconds));
+
+    MutatorStats mutator_stats;
+    vector<thread> threads;
+    for (int i = 0; i < options.thread_count; ++i) {
+        threads.emplace_back(RunClient, cref(search_server), ref(index_mutex), cref(queries), cref(options), i, end_time, ref(client_stats[i]));
+    }
+    if (options.mutation_rate > 0) {
+        threads.emplace_back([&] {
+            mutator_stats = RunMutator(search_server, index_mutex, corpus, options, end_time);
+        });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+    const double elapsed_seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+
+    ClientStats total;
+    for (const ClientStats& stats : client_stats) {
+        total.latencies.Merge(stats.latencies);
+        total.query_count += stats.query_count;
+        total.empty_count += stats.empty_count;
+        total.error_count += stats.error_count;
+        total.late_count += stats.late_count;
+    }
+
+    const auto to_us = [](chrono::nanoseconds latency) {
+        return latency.count() / 1000.0;
+    };
+    cout << fixed << setprecision(1);
+    cout << "mode: "s << (options.open_loop ? "open"s : "closed"s) << ", threads: "s << options.thread_count << '\n';
+    cout << "queries: "s << total.query_count << " in "s << elapsed_seconds << " s, "s
+         << total.query_count / elapsed_seconds << " queries/s\n"s;
+    cout << "empty results: "s << total.empty_count << '\n';
+    cout << "invalid queries: "s << total.error_count << '\n';
+    if (options.open_loop) {
+        cout << "late arrivals: "s << total.late_count << '\n';
+    }
+    if (options.mutation_rate > 0) {
+        cout << "mutations: "s << mutator_stats.mutation_count << ", rejected documents: "s << mutator_stats.error_count << '\n';
+    }
+    cout << "latency us: p50 = "s << to_us(total.latencies.GetPercentile(50))
+         << ", p99 = "s << to_us(total.latencies.GetPercentile(99))
+         << ", p99.9 = "s << to_us(total.latencies.GetPercentile(99.9)) << endl;
+}
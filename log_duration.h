@@ -1,8 +1,17 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <string_view>
+#include <vector>
 
 #define PROFILE_CONCAT_INTERNAL(X, Y) X##Y
 #define PROFILE_CONCAT(X, Y) PROFILE_CONCAT_INTERNAL(X, Y)
@@ -33,4 +42,245 @@ private:
     const std::string id_;
     const Clock::time_point start_time_ = Clock::now();
     std::ostream& dst_stream_;
-};
\ No newline at end of file
+};
+
+// Scoped profiler. PROFILE_SCOPE("name") times the rest of the enclosing block with
+// nanosecond resolution. Each thread aggregates into its own counters without locks or
+// atomic read-modify-writes; DumpProfile merges all threads on demand and prints the
+// scopes as a tree of the places they were first entered from.
+// Without SEARCH_SERVER_PROFILING the macro expands to nothing and DumpProfile is empty.
+#ifdef SEARCH_SERVER_PROFILING
+#define PROFILE_SCOPE(name) \
+    static ProfileSite PROFILE_CONCAT(profileSite, __LINE__)(name); \
+    ProfileScope UNIQUE_VAR_NAME_PROFILE(PROFILE_CONCAT(profileSite, __LINE__))
+#else
+#define PROFILE_SCOPE(name) static_cast<void>(0)
+#endif
+
+// scope sites past this many are not profiled
+const int MAX_PROFILE_SITES = 128;
+// log2 buckets of scope durations in nanoseconds
+const int PROFILE_HISTOGRAM_BUCKETS = 48;
+
+struct ProfileCounters {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> total_ns{0};
+    // time spent in nested scopes
+    std::atomic<uint64_t> child_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+    std::array<std::atomic<uint64_t>, PROFILE_HISTOGRAM_BUCKETS> histogram{};
+};
+
+// Counters of one thread. Only the owning thread writes, so plain load and store are
+// enough; relaxed atomics only make the concurrent reads of DumpProfile well defined.
+class ThreadProfile {
+public:
+    void Record(int site_id, uint64_t duration_ns) {
+        ProfileCounters& counters = sites_[site_id];
+        Add(counters.count, 1);
+        Add(counters.total_ns, duration_ns);
+        if (duration_ns > counters.max_ns.load(std::memory_order_relaxed)) {
+            counters.max_ns.store(duration_ns, std::memory_order_relaxed);
+        }
+        int bucket = 0;
+        while ((duration_ns >> bucket) > 1 && bucket + 1 < PROFILE_HISTOGRAM_BUCKETS) {
+            ++bucket;
+        }
+        Add(counters.histogram[bucket], 1);
+    }
+
+    void RecordChild(int site_id, uint64_t duration_ns) {
+        Add(sites_[site_id].child_ns, duration_ns);
+    }
+
+    const ProfileCounters& GetCounters(int site_id) const {
+        return sites_[site_id];
+    }
+
+private:
+    std::array<ProfileCounters, MAX_PROFILE_SITES> sites_;
+
+    static void Add(std::atomic<uint64_t>& counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+};
+
+class ProfileRegistry {
+public:
+    static ProfileRegistry& Instance() {
+        static ProfileRegistry registry;
+        return registry;
+    }
+
+    // -1 when all MAX_PROFILE_SITES are taken
+    int AddSite(std::string_view name) {
+        std::lock_guard guard(mutex_);
+        if (site_names_.size() == MAX_PROFILE_SITES) {
+            return -1;
+        }
+        site_names_.emplace_back(name);
+        site_parents_[site_names_.size() - 1].store(UNKNOWN_PARENT, std::memory_order_relaxed);
+        return static_cast<int>(site_names_.size()) - 1;
+    }
+
+    // the first parent a site is entered from; -1 for top-level scopes
+    void SetParent(int site_id, int parent_id) {
+        std::atomic<int>& parent = site_parents_[site_id];
+        if (parent.load(std::memory_order_relaxed) == UNKNOWN_PARENT) {
+            int expected = UNKNOWN_PARENT;
+            parent.compare_exchange_strong(expected, parent_id, std::memory_order_relaxed);
+        }
+    }
+
+    // counters of the calling thread, kept alive by the registry after the thread exits
+    static ThreadProfile& GetThreadProfile() {
+        thread_local std::shared_ptr<ThreadProfile> profile = Instance().AddThread();
+        return *profile;
+    }
+
+    void Dump(std::ostream& out) const;
+
+private:
+    static constexpr int UNKNOWN_PARENT = -2;
+
+    mutable std::mutex mutex_;
+    std::vector<std::string> site_names_;
+    std::array<std::atomic<int>, MAX_PROFILE_SITES> site_parents_{};
+    std::vector<std::shared_ptr<ThreadProfile>> threads_;
+
+    std::shared_ptr<ThreadProfile> AddThread() {
+        auto profile = std::make_shared<ThreadProfile>();
+        std::lock_guard guard(mutex_);
+        threads_.push_back(profile);
+        return profile;
+    }
+
+    std::vector<std::string> GetPath(int site_id) const {
+        std::vector<std::string> path;
+        for (int depth = 0; site_id >= 0 && depth < MAX_PROFILE_SITES; ++depth) {
+            path.insert(path.begin(), site_names_[site_id]);
+            site_id = site_parents_[site_id].load(std::memory_order_relaxed);
+        }
+        return path;
+    }
+};
+
+class ProfileSite {
+public:
+    explicit ProfileSite(std::string_view name)
+            : id_(ProfileRegistry::Instance().AddSite(name)) {
+    }
+
+    int GetId() const {
+        return id_;
+    }
+
+private:
+    const int id_;
+};
+
+class ProfileScope {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ProfileScope(const ProfileSite& site)
+            : site_id_(site.GetId())
+            , parent_(current_) {
+        current_ = this;
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+    ~ProfileScope() {
+        const uint64_t duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time_).count();
+        current_ = parent_;
+        if (site_id_ < 0) {
+            return;
+        }
+        ThreadProfile& profile = ProfileRegistry::GetThreadProfile();
+        profile.Record(site_id_, duration_ns);
+        const int parent_id = parent_ == nullptr ? -1 : parent_->site_id_;
+        if (parent_id >= 0) {
+            profile.RecordChild(parent_id, duration_ns);
+        }
+        ProfileRegistry::Instance().SetParent(site_id_, parent_id);
+    }
+
+private:
+    inline static thread_local ProfileScope* current_ = nullptr;
+
+    const int site_id_;
+    ProfileScope* const parent_;
+    const Clock::time_point start_time_ = Clock::now();
+};
+
+inline void ProfileRegistry::Dump(std::ostream& out) const {
+    using namespace std::literals;
+
+    struct Totals {
+        uint64_t count = 0;
+        uint64_t total_ns = 0;
+        uint64_t child_ns = 0;
+        uint64_t max_ns = 0;
+        std::array<uint64_t, PROFILE_HISTOGRAM_BUCKETS> histogram{};
+    };
+
+    std::lock_guard guard(mutex_);
+    // sites with the same path, e.g. instantiations of one template, are merged
+    std::map<std::vector<std::string>, Totals> path_to_totals;
+    for (int site_id = 0; site_id < static_cast<int>(site_names_.size()); ++site_id) {
+        Totals& totals = path_to_totals[GetPath(site_id)];
+        for (const auto& thread : threads_) {
+            const ProfileCounters& counters = thread->GetCounters(site_id);
+            totals.count += counters.count.load(std::memory_order_relaxed);
+            totals.total_ns += counters.total_ns.load(std::memory_order_relaxed);
+            totals.child_ns += counters.child_ns.load(std::memory_order_relaxed);
+            totals.max_ns = std::max(totals.max_ns, counters.max_ns.load(std::memory_order_relaxed));
+            for (int bucket = 0; bucket < PROFILE_HISTOGRAM_BUCKETS; ++bucket) {
+                totals.histogram[bucket] += counters.histogram[bucket].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // upper bound of the log2 bucket holding the given share of calls
+    const auto percentile = [](const Totals& totals, double share) -> uint64_t {
+        const auto rank = static_cast<uint64_t>(std::ceil(share * totals.count));
+        uint64_t seen = 0;
+        for (int bucket = 0; bucket < PROFILE_HISTOGRAM_BUCKETS; ++bucket) {
+            seen += totals.histogram[bucket];
+            if (seen >= rank && seen > 0) {
+                return std::min(totals.max_ns, (uint64_t{2} << bucket) - 1);
+            }
+        }
+        return totals.max_ns;
+    };
+
+    out << std::left << std::setw(40) << "scope"sv << std::right
+        << std::setw(12) << "calls"sv << std::setw(14) << "total_us"sv << std::setw(14) << "self_us"sv
+        << std::setw(12) << "mean_ns"sv << std::setw(12) << "p50_ns"sv << std::setw(12) << "p99_ns"sv
+        << std::setw(12) << "max_ns"sv << '\n';
+    for (const auto& [path, totals] : path_to_totals) {
+        if (totals.count == 0) {
+            continue;
+        }
+        const std::string indented_name = std::string(2 * (path.size() - 1), ' ') + path.back();
+        out << std::left << std::setw(40) << indented_name << std::right
+            << std::setw(12) << totals.count
+            << std::setw(14) << totals.total_ns / 1000
+            << std::setw(14) << (totals.total_ns - std::min(totals.child_ns, totals.total_ns)) / 1000
+            << std::setw(12) << totals.total_ns / totals.count
+            << std::setw(12) << percentile(totals, 0.5)
+            << std::setw(12) << percentile(totals, 0.99)
+            << std::setw(12) << totals.max_ns << '\n';
+    }
+    out.flush();
+}
+
+inline void DumpProfile(std::ostream& out = std::cerr) {
+#ifdef SEARCH_SERVER_PROFILING
+    ProfileRegistry::Instance().Dump(out);
+#else
+    static_cast<void>(out);
+#endif
+}
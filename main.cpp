@@ -1,6 +1,7 @@
 #include "process_queries.h"
 #include "search_server.h"
 #include "log_duration.h"
+#include "generators.h"
 
 #include <execution>
 #include <iostream>
@@ -17,49 +18,6 @@ void PrintDocument(const Document& document) {
          << "rating = "s << document.rating << " }"s << endl;
 }
 
-string GenerateWord(mt19937& generator, int max_length) {
-    const int length = uniform_int_distribution(1, max_length)(generator);
-    string word;
-    word.reserve(length);
-    for (int i = 0; i < length; ++i) {
-        word.push_back(uniform_int_distribution('a', 'z')(generator));
-    }
-    return word;
-}
-
-vector<string> GenerateDictionary(mt19937& generator, int word_count, int max_length) {
-    vector<string> words;
-    words.reserve(word_count);
-    for (int i = 0; i < word_count; ++i) {
-        words.push_back(GenerateWord(generator, max_length));
-    }
-    words.erase(unique(words.begin(), words.end()), words.end());
-    return words;
-}
-
-string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int word_count, double minus_prob = 0) {
-    string query;
-    for (int i = 0; i < word_count; ++i) {
-        if (!query.empty()) {
-            query.push_back(' ');
-        }
-        if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
-            query.push_back('-');
-        }
-        query += dictionary[uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
-    }
-    return query;
-}
-
-vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
-    vector<string> queries;
-    queries.reserve(query_count);
-    for (int i = 0; i < query_count; ++i) {
-        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
-    }
-    return queries;
-}
-
 template <typename ExecutionPolicy>
 void Test(string_view mark, const SearchServer& search_server, const vector<string>& queries, ExecutionPolicy&& policy) {
     LOG_DURATION(mark);
@@ -134,6 +92,24 @@ int main() {
                 PrintDocument(document);
             }
         }
+
+        cout << "Async:"s << endl;
+        {
+            search_server.SetAsyncThreadCount(2);
+            auto future_documents = search_server.FindTopDocumentsAsync("curly nasty cat"s);
+            for (const Document &document: future_documents.get()) {
+                PrintDocument(document);
+            }
+        }
+
+        cout << "Literal tilde:"s << endl;
+        {
+            // only a trailing "~" or "~N" asks for fuzzy matching
+            search_server.AddDocument(5, "backup~old c~b x~10"s, DocumentStatus::ACTUAL, {4});
+            for (const Document &document: search_server.FindTopDocuments("c~b x~10 ~/path~x"s)) {
+                PrintDocument(document);
+            }
+        }
     }
 
 
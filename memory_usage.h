@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Estimates of the heap bytes held by standard containers. They assume the libstdc++
+// layouts (a red-black tree node carries 32 bytes of links and color, a hash node a next
+// pointer and a cached hash) and glibc malloc, which adds an 8 byte header to every
+// chunk, rounds to 16 bytes and never returns less than 32.
+
+inline size_t EstimateAllocation(size_t size) {
+    return std::max<size_t>(32, (size + 8 + 15) / 16 * 16);
+}
+
+// Size class of a std::pmr pool resource for a request: libstdc++ pools hand out blocks
+// of these sizes without per-block headers and pass larger requests upstream.
+inline size_t EstimatePoolAllocation(size_t size) {
+    static const size_t pool_block_sizes[] = {8, 16, 24, 32, 48, 64, 80, 96, 112, 128, 192, 256, 320, 384, 448,
+                                              512, 768, 1024, 1536, 2048, 3072, 4096};
+    for (const size_t block_size : pool_block_sizes) {
+        if (size <= block_size) {
+            return block_size;
+        }
+    }
+    return EstimateAllocation(size);
+}
+
+template <typename T>
+size_t EstimateVectorBytes(const std::vector<T>& vector) {
+    return vector.capacity() == 0 ? 0 : EstimateAllocation(vector.capacity() * sizeof(T));
+}
+
+// short strings live inside the string object
+inline size_t EstimateStringBytes(const std::string& string) {
+    return string.capacity() <= 15 ? 0 : EstimateAllocation(string.capacity() + 1);
+}
+
+// nodes of a std::map or std::set, without what their values own
+template <typename Tree>
+size_t EstimateTreeNodeBytes(const Tree& tree, size_t (*estimate_allocation)(size_t) = EstimateAllocation) {
+    const size_t node_header_size = 32;
+    return tree.size() * estimate_allocation(node_header_size + sizeof(typename Tree::value_type));
+}
+
+// nodes and buckets of a std::unordered_map or std::unordered_set
+template <typename HashTable>
+size_t EstimateHashTableBytes(const HashTable& table) {
+    const size_t node_size = sizeof(void*) + sizeof(typename HashTable::value_type) + sizeof(size_t);
+    return table.size() * EstimateAllocation(node_size) + EstimateAllocation(table.bucket_count() * sizeof(void*));
+}
+
+// Heap bytes of the SearchServer index by component, see SearchServer::MemoryUsage.
+struct IndexMemoryUsage {
+    // interned words and stop words
+    size_t dictionary = 0;
+    // word_to_document_freqs_
+    size_t postings = 0;
+    // document_to_word_freqs_
+    size_t forward_index = 0;
+    // text of the documents
+    size_t document_contents = 0;
+    // document records, id and ordinal lists, status bitmaps, rating index and fingerprints
+    size_t attributes = 0;
+    // word positions, when stored
+    size_t positions = 0;
+
+    size_t GetTotal() const {
+        return dictionary + postings + forward_index + document_contents + attributes + positions;
+    }
+};
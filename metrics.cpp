@@ -0,0 +1,265 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+size_t GetMetricShard() {
+    static atomic<size_t> next_shard{0};
+    thread_local const size_t shard = next_shard.fetch_add(1, memory_order_relaxed) % METRIC_SHARD_COUNT;
+    return shard;
+}
+
+uint64_t Counter::GetValue() const {
+    uint64_t value = 0;
+    for (const Shard& shard : shards_) {
+        value += shard.value.load(memory_order_relaxed);
+    }
+    return value;
+}
+
+Histogram::Histogram(vector<double> upper_bounds)
+        : upper_bounds_(move(upper_bounds)) {
+    if (!is_sorted(upper_bounds_.begin(), upper_bounds_.end())) {
+        throw invalid_argument("Histogram bounds must be sorted"s);
+    }
+    for (Shard& shard : shards_) {
+        shard.bucket_counts = make_unique<atomic<uint64_t>[]>(upper_bounds_.size() + 1);
+        for (size_t i = 0; i <= upper_bounds_.size(); ++i) {
+            shard.bucket_counts[i].store(0, memory_order_relaxed);
+        }
+    }
+}
+
+void Histogram::Observe(double value) {
+    const size_t bucket = lower_bound(upper_bounds_.begin(), upper_bounds_.end(), value) - upper_bounds_.begin();
+    Shard& shard = shards_[GetMetricShard()];
+    shard.bucket_counts[bucket].fetch_add(1, memory_order_relaxed);
+    // threads rarely share a shard, so this loop almost never retries
+    double sum = shard.sum.load(memory_order_relaxed);
+    while (!shard.sum.compare_exchange_weak(sum, sum + value, memory_order_relaxed)) {
+    }
+}
+
+vector<uint64_t> Histogram::GetBucketCounts() const {
+    vector<uint64_t> counts(upper_bounds_.size() + 1);
+    for (const Shard& shard : shards_) {
+        for (size_t i = 0; i < counts.size(); ++i) {
+            counts[i] += shard.bucket_counts[i].load(memory_order_relaxed);
+        }
+    }
+    return counts;
+}
+
+uint64_t Histogram::GetCount() const {
+    const vector<uint64_t> counts = GetBucketCounts();
+    uint64_t count = 0;
+    for (const uint64_t bucket_count : counts) {
+        count += bucket_count;
+    }
+    return count;
+}
+
+double Histogram::GetSum() const {
+    double sum = 0.0;
+    for (const Shard& shard : shards_) {
+        sum += shard.sum.load(memory_order_relaxed);
+    }
+    return sum;
+}
+
+vector<double> MakeLatencyBuckets() {
+    return {1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3, 2.5e-3, 5e-3, 1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0};
+}
+
+MetricsRegistry::Metric& MetricsRegistry::AddMetric(const string& name, const string& help) {
+    auto [it, inserted] = metrics_.try_emplace(name);
+    if (inserted) {
+        it->second.help = help;
+    }
+    return it->second;
+}
+
+Counter& MetricsRegistry::GetCounter(const string& name, const string& help) {
+    lock_guard guard(mutex_);
+    Metric& metric = AddMetric(name, help);
+    if (!metric.counter) {
+        if (metric.gauge || metric.histogram || metric.callback) {
+            throw invalid_argument("Metric "s + name + " is not a counter"s);
+        }
+        metric.counter = make_unique<Counter>();
+    }
+    return *metric.counter;
+}
+
+Gauge& MetricsRegistry::GetGauge(const string& name, const string& help) {
+    lock_guard guard(mutex_);
+    Metric& metric = AddMetric(name, help);
+    if (!metric.gauge) {
+        if (metric.counter || metric.histogram || metric.callback) {
+            throw invalid_argument("Metric "s + name + " is not a gauge"s);
+        }
+        metric.gauge = make_unique<Gauge>();
+    }
+    return *metric.gauge;
+}
+
+Histogram& MetricsRegistry::GetHistogram(const string& name, const string& help, vector<double> upper_bounds) {
+    lock_guard guard(mutex_);
+    Metric& metric = AddMetric(name, help);
+    if (!metric.histogram) {
+        if (metric.counter || metric.gauge || metric.callback) {
+            throw invalid_argument("Metric "s + name + " is not a histogram"s);
+        }
+        metric.histogram = make_unique<Histogram>(move(upper_bounds));
+    }
+    return *metric.histogram;
+}
+
+uint64_t MetricsRegistry::AddCallbackGauge(const string& name, const string& help, function<double()> callback) {
+    return AddCallbackGauges({{name, help}}, [callback = move(callback)] {
+        return vector<double>{callback()};
+    });
+}
+
+uint64_t MetricsRegistry::AddCallbackGauges(const vector<pair<string, string>>& names_and_help, function<vector<double>()> callback) {
+    lock_guard guard(mutex_);
+    for (const auto& [name, help] : names_and_help) {
+        const auto it = metrics_.find(name);
+        if (it != metrics_.end() && (it->second.counter || it->second.gauge || it->second.histogram)) {
+            throw invalid_argument("Metric "s + name + " is not a gauge"s);
+        }
+    }
+    const auto shared_callback = make_shared<const function<vector<double>()>>(move(callback));
+    const uint64_t id = next_callback_id_++;
+    for (size_t i = 0; i < names_and_help.size(); ++i) {
+        Metric& metric = AddMetric(names_and_help[i].first, names_and_help[i].second);
+        metric.callback = shared_callback;
+        metric.callback_index = i;
+        metric.callback_id = id;
+    }
+    return id;
+}
+
+void MetricsRegistry::RemoveCallbackGauge(const string& name, uint64_t id) {
+    lock_guard guard(mutex_);
+    const auto it = metrics_.find(name);
+    if (it != metrics_.end() && it->second.callback_id == id) {
+        metrics_.erase(it);
+    }
+}
+
+namespace {
+
+// integral values such as byte counts are written in full rather than in the default
+// six significant digits
+ostream& WritePrometheusValue(ostream& out, double value) {
+    if (value == floor(value) && abs(value) < 1e15) {
+        return out << static_cast<int64_t>(value);
+    }
+    return out << value;
+}
+
+}  // namespace
+
+void MetricsRegistry::WritePrometheus(ostream& out) const {
+    lock_guard guard(mutex_);
+    // values of each callback, computed on its first gauge
+    map<const function<vector<double>()>*, vector<double>> callback_values;
+    for (const auto& [name, metric] : metrics_) {
+        out << "# HELP "s << name << ' ' << metric.help << '\n';
+        if (metric.counter) {
+            out << "# TYPE "s << name << " counter\n"s;
+            out << name << ' ' << metric.counter->GetValue() << '\n';
+        } else if (metric.gauge) {
+            out << "# TYPE "s << name << " gauge\n"s;
+            out << name << ' ' << metric.gauge->GetValue() << '\n';
+        } else if (metric.callback) {
+            out << "# TYPE "s << name << " gauge\n"s;
+            auto [cached, inserted] = callback_values.try_emplace(metric.callback.get());
+            if (inserted) {
+                cached->second = (*metric.callback)();
+            }
+            WritePrometheusValue(out << name << ' ', cached->second.at(metric.callback_index)) << '\n';
+        } else if (metric.histogram) {
+            out << "# TYPE "s << name << " histogram\n"s;
+            const vector<double>& upper_bounds = metric.histogram->GetUpperBounds();
+            const vector<uint64_t> counts = metric.histogram->GetBucketCounts();
+            uint64_t cumulative_count = 0;
+            for (size_t i = 0; i < counts.size(); ++i) {
+                cumulative_count += counts[i];
+                out << name << "_bucket{le=\""s;
+                if (i < upper_bounds.size()) {
+                    out << upper_bounds[i];
+                } else {
+                    out << "+Inf"s;
+                }
+                out << "\"} "s << cumulative_count << '\n';
+            }
+            out << name << "_sum "s << metric.histogram->GetSum() << '\n';
+            out << name << "_count "s << cumulative_count << '\n';
+        }
+    }
+    out.flush();
+}
+
+void MetricsRegistry::WritePrometheus(const string& file_name) const {
+    ofstream out(file_name);
+    if (!out) {
+        throw runtime_error("Cannot open "s + file_name);
+    }
+    WritePrometheus(out);
+}
+
+MetricsRegistration::MetricsRegistration(MetricsRegistry& registry)
+        : registry_(&registry) {
+}
+
+MetricsRegistration::~MetricsRegistration() {
+    Reset();
+}
+
+MetricsRegistration::MetricsRegistration(MetricsRegistration&& other) noexcept
+        : registry_(exchange(other.registry_, nullptr))
+        , callback_gauges_(move(other.callback_gauges_)) {
+}
+
+MetricsRegistration& MetricsRegistration::operator=(MetricsRegistration&& other) noexcept {
+    if (this != &other) {
+        Reset();
+        registry_ = exchange(other.registry_, nullptr);
+        callback_gauges_ = move(other.callback_gauges_);
+    }
+    return *this;
+}
+
+void MetricsRegistration::AddCallbackGauge(const string& name, const string& help, function<double()> callback) {
+    if (registry_ == nullptr) {
+        throw logic_error("Registration has no registry"s);
+    }
+    callback_gauges_.emplace_back(name, registry_->AddCallbackGauge(name, help, move(callback)));
+}
+
+void MetricsRegistration::AddCallbackGauges(const vector<pair<string, string>>& names_and_help, function<vector<double>()> callback) {
+    if (registry_ == nullptr) {
+        throw logic_error("Registration has no registry"s);
+    }
+    const uint64_t id = registry_->AddCallbackGauges(names_and_help, move(callback));
+    for (const auto& [name, help] : names_and_help) {
+        callback_gauges_.emplace_back(name, id);
+    }
+}
+
+void MetricsRegistration::Reset() {
+    if (registry_ != nullptr) {
+        for (const auto& [name, id] : callback_gauges_) {
+            registry_->RemoveCallbackGauge(name, id);
+        }
+    }
+    callback_gauges_.clear();
+    registry_ = nullptr;
+}
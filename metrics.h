@@ -0,0 +1,148 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Metrics in the Prometheus text exposition format. Updates touch a per-thread shard with
+// one relaxed atomic add, so they are cheap enough for the query path; reads sum the shards.
+
+const size_t METRIC_SHARD_COUNT = 16;
+
+// shard of the calling thread, assigned round-robin on first use
+size_t GetMetricShard();
+
+class Counter {
+public:
+    void Increment(uint64_t value = 1) {
+        shards_[GetMetricShard()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    uint64_t GetValue() const;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+
+    std::array<Shard, METRIC_SHARD_COUNT> shards_;
+};
+
+class Gauge {
+public:
+    void Set(int64_t value) {
+        value_.store(value, std::memory_order_relaxed);
+    }
+
+    void Add(int64_t value) {
+        value_.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    int64_t GetValue() const {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+// Cumulative buckets with the given upper bounds, plus the implicit +Inf bucket.
+class Histogram {
+public:
+    explicit Histogram(std::vector<double> upper_bounds);
+
+    void Observe(double value);
+
+    const std::vector<double>& GetUpperBounds() const {
+        return upper_bounds_;
+    }
+
+    // per bucket, not cumulative; the last one is +Inf
+    std::vector<uint64_t> GetBucketCounts() const;
+    uint64_t GetCount() const;
+    double GetSum() const;
+
+private:
+    struct alignas(64) Shard {
+        std::unique_ptr<std::atomic<uint64_t>[]> bucket_counts;
+        std::atomic<double> sum{0.0};
+    };
+
+    const std::vector<double> upper_bounds_;
+    std::array<Shard, METRIC_SHARD_COUNT> shards_;
+};
+
+// Latency buckets in seconds, from 10 us to 10 s.
+std::vector<double> MakeLatencyBuckets();
+
+// Owns the metrics by name. Counters, gauges and histograms are never removed, so the
+// returned references stay valid for the life of the registry; callback gauges can be.
+class MetricsRegistry {
+public:
+    Counter& GetCounter(const std::string& name, const std::string& help);
+    Gauge& GetGauge(const std::string& name, const std::string& help);
+    Histogram& GetHistogram(const std::string& name, const std::string& help, std::vector<double> upper_bounds);
+    // Read at dump time, e.g. sizes of an index. Returns an id for RemoveCallbackGauge; a
+    // later callback of the same name replaces this one.
+    uint64_t AddCallbackGauge(const std::string& name, const std::string& help, std::function<double()> callback);
+    // Gauges computed together: callback returns their values in the order of names_and_help
+    // and runs once per dump. The id removes each of them with RemoveCallbackGauge.
+    uint64_t AddCallbackGauges(const std::vector<std::pair<std::string, std::string>>& names_and_help,
+                               std::function<std::vector<double>()> callback);
+    // Removes the callback if it is still the one added with id. Once this returns the
+    // callback is not running and will not run again.
+    void RemoveCallbackGauge(const std::string& name, uint64_t id);
+
+    void WritePrometheus(std::ostream& out) const;
+    // throws runtime_error if the file cannot be written
+    void WritePrometheus(const std::string& file_name) const;
+
+private:
+    struct Metric {
+        std::string help;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+        // shared by the gauges of one AddCallbackGauges call
+        std::shared_ptr<const std::function<std::vector<double>()>> callback;
+        size_t callback_index = 0;
+        uint64_t callback_id = 0;
+    };
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Metric> metrics_;
+    uint64_t next_callback_id_ = 1;
+
+    Metric& AddMetric(const std::string& name, const std::string& help);
+};
+
+// Callback gauges of one object, removed when the registration is destroyed. An object
+// whose gauges read its own state keeps one as a member, so that dumping the registry
+// never calls into a destroyed object.
+class MetricsRegistration {
+public:
+    MetricsRegistration() = default;
+    explicit MetricsRegistration(MetricsRegistry& registry);
+    ~MetricsRegistration();
+
+    MetricsRegistration(MetricsRegistration&& other) noexcept;
+    MetricsRegistration& operator=(MetricsRegistration&& other) noexcept;
+
+    void AddCallbackGauge(const std::string& name, const std::string& help, std::function<double()> callback);
+    void AddCallbackGauges(const std::vector<std::pair<std::string, std::string>>& names_and_help,
+                           std::function<std::vector<double>()> callback);
+
+private:
+    MetricsRegistry* registry_ = nullptr;
+    std::vector<std::pair<std::string, uint64_t>> callback_gauges_;
+
+    void Reset();
+};
@@ -0,0 +1,126 @@
+#include "near_duplicates.h"
+#include "document_fingerprint.h"
+
+#include <unordered_set>
+
+using namespace std;
+
+namespace {
+
+double ComputeJaccard(const SearchServer::WordFrequencies& lhs, const SearchServer::WordFrequencies& rhs) {
+    size_t common = 0;
+    auto lhs_it = lhs.begin();
+    auto rhs_it = rhs.begin();
+    while (lhs_it != lhs.end() && rhs_it != rhs.end()) {
+        if (lhs_it->first < rhs_it->first) {
+            ++lhs_it;
+        } else if (rhs_it->first < lhs_it->first) {
+            ++rhs_it;
+        } else {
+            ++common;
+            ++lhs_it;
+            ++rhs_it;
+        }
+    }
+    const size_t united = lhs.size() + rhs.size() - common;
+    return united == 0 ? 0.0 : static_cast<double>(common) / united;
+}
+
+}
+
+vector<NearDuplicate> FindNearDuplicates(const SearchServer& search_server, const NearDuplicateOptions& options) {
+    if (options.band_count <= 0 || options.rows_per_band <= 0) {
+        throw invalid_argument("MinHash signature must have at least one band and one row"s);
+    }
+    const size_t signature_size = static_cast<size_t>(options.band_count) * options.rows_per_band;
+
+    vector<int> document_ids(search_server.begin(), search_server.end());
+    sort(document_ids.begin(), document_ids.end());
+
+    vector<uint64_t> hash_seeds(signature_size);
+    for (size_t i = 0; i < signature_size; ++i) {
+        hash_seeds[i] = MixBits(options.seed + i);
+    }
+
+    // signatures[document * signature_size + i] is the minimum of the i-th hash over the words
+    vector<uint64_t> signatures(document_ids.size() * signature_size);
+    vector<size_t> document_indexes(document_ids.size());
+    iota(document_indexes.begin(), document_indexes.end(), 0);
+    for_each(execution::par, document_indexes.begin(), document_indexes.end(), [&](size_t index) {
+        const auto signature = signatures.begin() + index * signature_size;
+        fill(signature, signature + signature_size, numeric_limits<uint64_t>::max());
+        for (const auto& [word, _] : search_server.GetWordFrequencies(document_ids[index])) {
+            const uint64_t word_hash = hash<string_view>{}(word);
+            for (size_t i = 0; i < signature_size; ++i) {
+                signature[i] = min(signature[i], MixBits(word_hash ^ hash_seeds[i]));
+            }
+        }
+    });
+
+    vector<pair<size_t, size_t>> candidates;
+    vector<pair<uint64_t, size_t>> buckets(document_ids.size());
+    for (int band = 0; band < options.band_count; ++band) {
+        const size_t band_offset = static_cast<size_t>(band) * options.rows_per_band;
+        for (size_t index = 0; index < document_ids.size(); ++index) {
+            uint64_t band_hash = MixBits(band);
+            for (int row = 0; row < options.rows_per_band; ++row) {
+                band_hash = MixBits(band_hash ^ signatures[index * signature_size + band_offset + row]);
+            }
+            buckets[index] = {band_hash, index};
+        }
+        sort(execution::par, buckets.begin(), buckets.end());
+
+        for (size_t bucket_begin = 0; bucket_begin < buckets.size();) {
+            size_t bucket_end = bucket_begin + 1;
+            while (bucket_end < buckets.size() && buckets[bucket_end].first == buckets[bucket_begin].first) {
+                ++bucket_end;
+            }
+            for (size_t i = bucket_begin + 1; i < bucket_end; ++i) {
+                const size_t first = i - min(i - bucket_begin, options.max_bucket_comparisons);
+                for (size_t j = first; j < i; ++j) {
+                    candidates.emplace_back(buckets[j].second, buckets[i].second);
+                }
+            }
+            bucket_begin = bucket_end;
+        }
+    }
+    sort(execution::par, candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+
+    // words of documents without any word hash to the same signature, which is not a similarity
+    vector<double> similarities(candidates.size());
+    transform(execution::par, candidates.begin(), candidates.end(), similarities.begin(),
+              [&](const pair<size_t, size_t>& candidate) {
+        return ComputeJaccard(search_server.GetWordFrequencies(document_ids[candidate.first]),
+                              search_server.GetWordFrequencies(document_ids[candidate.second]));
+    });
+
+    vector<NearDuplicate> near_duplicates;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (similarities[i] > 0.0 && similarities[i] >= options.jaccard_threshold) {
+            near_duplicates.push_back({document_ids[candidates[i].first],
+                                       document_ids[candidates[i].second],
+                                       similarities[i]});
+        }
+    }
+    sort(near_duplicates.begin(), near_duplicates.end(), [](const NearDuplicate& lhs, const NearDuplicate& rhs) {
+        return tie(lhs.duplicate_id, lhs.original_id) < tie(rhs.duplicate_id, rhs.original_id);
+    });
+    return near_duplicates;
+}
+
+void RemoveNearDuplicates(SearchServer& search_server, const NearDuplicateOptions& options) {
+    unordered_set<int> removed;
+    // pairs come ordered by duplicate id, so whether an original survives is already known
+    for (const NearDuplicate& near_duplicate : FindNearDuplicates(search_server, options)) {
+        if (removed.count(near_duplicate.duplicate_id) || removed.count(near_duplicate.original_id)) {
+            continue;
+        }
+        cout << "Found near-duplicate document id "s << near_duplicate.duplicate_id
+             << " of document id "s << near_duplicate.original_id << endl;
+        removed.insert(near_duplicate.duplicate_id);
+    }
+    for (int document_id : removed) {
+        search_server.RemoveDocument(document_id);
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "search_server.h"
+
+struct NearDuplicateOptions {
+    // a pair of documents becomes a candidate when all rows of any band agree, so
+    // more bands catch lower similarities and more rows reject them
+    int band_count = 16;
+    int rows_per_band = 4;
+    double jaccard_threshold = 0.8;
+    // at most this many preceding documents of an LSH bucket are compared with each member
+    size_t max_bucket_comparisons = 64;
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+};
+
+struct NearDuplicate {
+    int original_id = 0;
+    int duplicate_id = 0;
+    double jaccard = 0.0;
+};
+
+// Pairs of documents whose word sets have a Jaccard similarity of at least the threshold,
+// ordered by duplicate_id, original_id; original_id is always the lower id. Candidates come
+// from MinHash signatures bucketed by LSH bands, so the work stays near-linear in corpus size.
+std::vector<NearDuplicate> FindNearDuplicates(const SearchServer& search_server,
+                                              const NearDuplicateOptions& options = {});
+
+// Keeps the lowest id of every group of near-duplicates and removes the others.
+void RemoveNearDuplicates(SearchServer& search_server, const NearDuplicateOptions& options = {});
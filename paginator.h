@@ -2,6 +2,12 @@
 
 #include <algorithm>
 #include <cassert>
+#include <iterator>
+#include <optional>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 template <typename Iterator>
 class IteratorRange {
@@ -74,3 +80,150 @@ template <typename Container>
 auto Paginate(const Container& c, size_t page_size) {
     return Paginator(begin(c), end(c), page_size);
 }
+
+// Computes pages on access instead of storing them, so construction is O(1). Random access
+// to a page and size() need random-access iterators; forward iterators can still be walked
+// page by page with begin()/end().
+template <typename Iterator>
+class LazyPaginator {
+public:
+    static constexpr bool is_random_access = std::is_base_of_v<
+            std::random_access_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>;
+
+    class PageIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = IteratorRange<Iterator>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = value_type;
+
+        PageIterator(Iterator page_begin, Iterator end, size_t page_size)
+                : page_begin_(page_begin)
+                , page_end_(AdvancePage(page_begin, end, page_size))
+                , end_(end)
+                , page_size_(page_size) {
+        }
+
+        IteratorRange<Iterator> operator*() const {
+            return {page_begin_, page_end_};
+        }
+
+        PageIterator& operator++() {
+            page_begin_ = page_end_;
+            page_end_ = AdvancePage(page_begin_, end_, page_size_);
+            return *this;
+        }
+
+        PageIterator operator++(int) {
+            PageIterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const PageIterator& other) const {
+            return page_begin_ == other.page_begin_;
+        }
+
+        bool operator!=(const PageIterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        Iterator page_begin_, page_end_, end_;
+        size_t page_size_;
+    };
+
+    LazyPaginator(Iterator begin, Iterator end, size_t page_size)
+            : begin_(begin)
+            , end_(end)
+            , page_size_(page_size) {
+        assert(page_size > 0);
+    }
+
+    IteratorRange<Iterator> operator[](size_t index) const {
+        static_assert(is_random_access, "Random access to pages needs random-access iterators");
+        assert(index < size());
+        const Iterator page_begin = std::next(begin_, index * page_size_);
+        return {page_begin, AdvancePage(page_begin, end_, page_size_)};
+    }
+
+    size_t size() const {
+        static_assert(is_random_access, "Page count of forward iterators is not known up front");
+        const size_t item_count = std::distance(begin_, end_);
+        return (item_count + page_size_ - 1) / page_size_;
+    }
+
+    PageIterator begin() const {
+        return {begin_, end_, page_size_};
+    }
+
+    PageIterator end() const {
+        return {end_, end_, page_size_};
+    }
+
+private:
+    Iterator begin_, end_;
+    size_t page_size_;
+
+    static Iterator AdvancePage(Iterator page_begin, Iterator end, size_t page_size) {
+        if constexpr (is_random_access) {
+            return std::next(page_begin, std::min<size_t>(page_size, std::distance(page_begin, end)));
+        } else {
+            for (size_t i = 0; i < page_size && page_begin != end; ++i) {
+                ++page_begin;
+            }
+            return page_begin;
+        }
+    }
+};
+
+template <typename Container>
+auto PaginateLazily(const Container& c, size_t page_size) {
+    return LazyPaginator(begin(c), end(c), page_size);
+}
+
+// Pages of a single-pass source, e.g. a stream or results produced on demand. The generator
+// returns std::optional<T> and std::nullopt once exhausted; only the current page is held.
+template <typename Generator>
+class StreamPaginator {
+public:
+    using value_type = typename std::invoke_result_t<Generator&>::value_type;
+
+    StreamPaginator(Generator generator, size_t page_size)
+            : generator_(std::move(generator))
+            , page_size_(page_size) {
+        assert(page_size > 0);
+    }
+
+    // empty once the source is exhausted
+    std::vector<value_type> NextPage() {
+        std::vector<value_type> page;
+        while (!exhausted_ && page.size() < page_size_) {
+            std::optional<value_type> item = generator_();
+            if (!item) {
+                exhausted_ = true;
+                break;
+            }
+            page.push_back(std::move(*item));
+        }
+        return page;
+    }
+
+private:
+    Generator generator_;
+    size_t page_size_;
+    bool exhausted_ = false;
+};
+
+// pages of [begin, end) for input iterators, which cannot be revisited
+template <typename InputIterator>
+auto PaginateStream(InputIterator begin, InputIterator end, size_t page_size) {
+    using Value = typename std::iterator_traits<InputIterator>::value_type;
+    return StreamPaginator([begin, end]() mutable -> std::optional<Value> {
+        if (begin == end) {
+            return std::nullopt;
+        }
+        return *begin++;
+    }, page_size);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Increasing positions of a word in one document, stored as varint-encoded deltas.
+class PositionList {
+public:
+    void Add(uint32_t position);
+
+    std::vector<uint32_t> Decode() const;
+    size_t GetByteSize() const;
+    size_t GetCapacityBytes() const;
+
+private:
+    std::vector<uint8_t> bytes_;
+    uint32_t last_position_ = 0;
+};
@@ -0,0 +1,69 @@
+#include "query_arena.h"
+
+using namespace std;
+
+QueryArena::Scope::Scope()
+        : arena_(ForThisThread()) {
+    ++arena_.scope_depth_;
+}
+
+QueryArena::Scope::~Scope() {
+    if (--arena_.scope_depth_ == 0) {
+        arena_.Release();
+    }
+}
+
+pmr::memory_resource* QueryArena::Scope::GetResource() const {
+    return &*arena_.resource_;
+}
+
+size_t QueryArena::SpillResource::GetSpilledBytes() const {
+    return spilled_bytes_;
+}
+
+void QueryArena::SpillResource::ResetSpilledBytes() {
+    spilled_bytes_ = 0;
+}
+
+void* QueryArena::SpillResource::do_allocate(size_t bytes, size_t alignment) {
+    spilled_bytes_ += bytes;
+    return pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void QueryArena::SpillResource::do_deallocate(void* p, size_t bytes, size_t alignment) {
+    pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+bool QueryArena::SpillResource::do_is_equal(const pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+QueryArena::QueryArena()
+        : buffer_(make_unique<byte[]>(initial_buffer_size_))
+        , buffer_size_(initial_buffer_size_) {
+    resource_.emplace(buffer_.get(), buffer_size_, &spill_resource_);
+}
+
+QueryArena& QueryArena::ForThisThread() {
+    thread_local QueryArena arena;
+    return arena;
+}
+
+void QueryArena::Release() {
+    const size_t spilled_bytes = spill_resource_.GetSpilledBytes();
+    spill_resource_.ResetSpilledBytes();
+    size_t new_buffer_size = buffer_size_;
+    if (spilled_bytes > 0) {
+        new_buffer_size = spilled_bytes <= max_retained_buffer_size_ - buffer_size_
+                          ? buffer_size_ + spilled_bytes : initial_buffer_size_;
+    }
+    if (new_buffer_size == buffer_size_) {
+        resource_->release();
+        return;
+    }
+    // the monotonic resource keeps a pointer to the buffer, so it goes first
+    resource_.reset();
+    buffer_size_ = new_buffer_size;
+    buffer_ = make_unique<byte[]>(buffer_size_);
+    resource_.emplace(buffer_.get(), buffer_size_, &spill_resource_);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+// Per-thread monotonic arena for the temporaries of a search: the parsed query, the
+// split words and the unsorted matches. Allocation is a pointer bump and nothing is freed
+// until the outermost QueryArena::Scope of the thread ends. A search that overflows the
+// buffer takes the extra memory from the heap, and the buffer grows so that later
+// searches of that size stay inside it. A search too large for a retained buffer returns
+// it to the initial size, so one huge query does not pin its memory in every thread.
+class QueryArena {
+public:
+    class Scope {
+    public:
+        Scope();
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        std::pmr::memory_resource* GetResource() const;
+
+    private:
+        QueryArena& arena_;
+    };
+
+private:
+    // counts the bytes the arena takes from the heap once its buffer is used up
+    class SpillResource : public std::pmr::memory_resource {
+    public:
+        size_t GetSpilledBytes() const;
+        void ResetSpilledBytes();
+
+    private:
+        size_t spilled_bytes_ = 0;
+
+        void* do_allocate(size_t bytes, size_t alignment) override;
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+    };
+
+    static const size_t initial_buffer_size_ = 64 * 1024;
+    static const size_t max_retained_buffer_size_ = 1024 * 1024;
+
+    std::unique_ptr<std::byte[]> buffer_;
+    size_t buffer_size_ = 0;
+    SpillResource spill_resource_;
+    std::optional<std::pmr::monotonic_buffer_resource> resource_;
+    int scope_depth_ = 0;
+
+    QueryArena();
+    static QueryArena& ForThisThread();
+    void Release();
+};
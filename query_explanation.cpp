@@ -0,0 +1,60 @@
+#include "query_explanation.h"
+
+using namespace std;
+
+void QueryExplainTracer::OnTerm(string_view word, size_t document_freq, double inverse_document_freq) {
+    lock_guard guard(mutex_);
+    explanation_.terms.push_back({string(word), document_freq, inverse_document_freq});
+}
+
+QueryExplanation QueryExplainTracer::TakeExplanation() {
+    lock_guard guard(mutex_);
+    explanation_.postings_visited = postings_visited_.load(memory_order_relaxed);
+    explanation_.predicate_calls = predicate_calls_.load(memory_order_relaxed);
+    explanation_.candidate_count = candidate_count_.load(memory_order_relaxed);
+    explanation_.pruned_count = pruned_count_.load(memory_order_relaxed);
+    return move(explanation_);
+}
+
+void QueryExplainTracer::AddTime(QueryPhase phase, Clock::duration duration) {
+    const auto nanoseconds = chrono::duration_cast<chrono::nanoseconds>(duration);
+    lock_guard guard(mutex_);
+    switch (phase) {
+        case QueryPhase::PARSE:
+            explanation_.parse_time += nanoseconds;
+            break;
+        case QueryPhase::TRAVERSAL:
+            explanation_.traversal_time += nanoseconds;
+            break;
+        case QueryPhase::FILTERING:
+            explanation_.filtering_time += nanoseconds;
+            break;
+        case QueryPhase::RANKING:
+            explanation_.ranking_time += nanoseconds;
+            break;
+    }
+}
+
+ostream& operator<<(ostream& out, const QueryExplanation& explanation) {
+    using namespace std::string_literals;
+    out << "parse = "s << explanation.parse_time.count() << " ns, "s
+        << "traversal = "s << explanation.traversal_time.count() << " ns, "s
+        << "filtering = "s << explanation.filtering_time.count() << " ns, "s
+        << "ranking = "s << explanation.ranking_time.count() << " ns\n"s;
+    out << "postings visited = "s << explanation.postings_visited << ", "s
+        << "predicate calls = "s << explanation.predicate_calls << ", "s
+        << "candidates = "s << explanation.candidate_count << ", "s
+        << "pruned = "s << explanation.pruned_count << '\n';
+    for (const TermExplanation& term : explanation.terms) {
+        out << "term "s << term.word << ": df = "s << term.document_freq
+            << ", idf = "s << term.inverse_document_freq << '\n';
+    }
+    for (const DocumentExplanation& document : explanation.documents) {
+        out << "document "s << document.document_id << ':';
+        for (size_t i = 0; i < document.term_contributions.size(); ++i) {
+            out << ' ' << explanation.terms[i].word << " = "s << document.term_contributions[i];
+        }
+        out << '\n';
+    }
+    return out;
+}
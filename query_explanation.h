@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Explain output of SearchServer::ExplainTopDocuments: where a query spent its time and
+// how the returned documents were scored.
+
+enum class QueryPhase {
+    PARSE,
+    // scoring the postings of the plus words
+    TRAVERSAL,
+    // dropping documents with minus words or without a quoted phrase
+    FILTERING,
+    // sorting and truncating to MAX_RESULT_DOCUMENT_COUNT
+    RANKING,
+};
+
+struct TermExplanation {
+    std::string word;
+    size_t document_freq = 0;
+    // multiplied by the fuzzy weight of the word, if any
+    double inverse_document_freq = 0.0;
+};
+
+struct DocumentExplanation {
+    int document_id = 0;
+    // score of every term of QueryExplanation::terms in this document, zero if absent
+    std::vector<double> term_contributions;
+};
+
+struct QueryExplanation {
+    std::chrono::nanoseconds parse_time{0};
+    std::chrono::nanoseconds traversal_time{0};
+    std::chrono::nanoseconds filtering_time{0};
+    std::chrono::nanoseconds ranking_time{0};
+
+    size_t postings_visited = 0;
+    // calls of a DocumentPredicate; status and DocumentFilter searches test bitmaps instead
+    size_t predicate_calls = 0;
+    // documents scored by the plus words
+    size_t candidate_count = 0;
+    // candidates dropped by minus words and phrases
+    size_t pruned_count = 0;
+
+    std::vector<TermExplanation> terms;
+    // one per returned document, in the order of the results
+    std::vector<DocumentExplanation> documents;
+};
+
+std::ostream& operator<<(std::ostream& out, const QueryExplanation& explanation);
+
+// The tracer of ordinary searches; every hook compiles to nothing.
+struct NullQueryTracer {
+    struct Timer {
+        // user-provided so that an unused timer does not trigger warnings
+        ~Timer() {
+        }
+    };
+
+    Timer StartTimer(QueryPhase) {
+        return {};
+    }
+
+    void OnTerm(std::string_view, size_t, double) {
+    }
+
+    void OnPostings(size_t) {
+    }
+
+    void OnPredicateCall() {
+    }
+
+    void OnCandidates(size_t) {
+    }
+
+    void OnPruned(size_t) {
+    }
+};
+
+// Collects a QueryExplanation. Hooks may be called from the threads of a parallel search.
+class QueryExplainTracer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    class Timer {
+    public:
+        Timer(QueryExplainTracer& tracer, QueryPhase phase)
+                : tracer_(tracer)
+                , phase_(phase) {
+        }
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        ~Timer() {
+            tracer_.AddTime(phase_, Clock::now() - start_time_);
+        }
+
+    private:
+        QueryExplainTracer& tracer_;
+        const QueryPhase phase_;
+        const Clock::time_point start_time_ = Clock::now();
+    };
+
+    Timer StartTimer(QueryPhase phase) {
+        return {*this, phase};
+    }
+
+    void OnTerm(std::string_view word, size_t document_freq, double inverse_document_freq);
+
+    void OnPostings(size_t visited) {
+        postings_visited_.fetch_add(visited, std::memory_order_relaxed);
+    }
+
+    void OnPredicateCall() {
+        predicate_calls_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void OnCandidates(size_t count) {
+        candidate_count_.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void OnPruned(size_t count) {
+        pruned_count_.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    // everything but the per-document contributions, which only the server can compute
+    QueryExplanation TakeExplanation();
+
+private:
+    std::mutex mutex_;
+    QueryExplanation explanation_;
+    std::atomic<size_t> postings_visited_{0};
+    std::atomic<size_t> predicate_calls_{0};
+    std::atomic<size_t> candidate_count_{0};
+    std::atomic<size_t> pruned_count_{0};
+
+    void AddTime(QueryPhase phase, Clock::duration duration);
+};
@@ -1,25 +1,63 @@
 #include "remove_duplicates.h"
+#include "document_fingerprint.h"
 
 using namespace std;
 
-void RemoveDuplicates(SearchServer& search_server){
-    std::map<set<string_view>, map<int, int>> aux_map ;
-    vector<int> documents_to_delete;
-    for (const int document_id : search_server){
-        set<string_view> document_words;
-        for (const auto& word_freq : search_server.GetWordFrequencies(document_id)){
-            document_words.insert(word_freq.first);
+namespace {
+
+bool HaveSameWords(const SearchServer::WordFrequencies& lhs, const SearchServer::WordFrequencies& rhs) {
+    return lhs.size() == rhs.size()
+           && equal(lhs.begin(), lhs.end(), rhs.begin(), [](const auto& lhs_word, const auto& rhs_word) {
+               return lhs_word.first == rhs_word.first;
+           });
+}
+
+}
+
+vector<int> FindDuplicates(const SearchServer& search_server){
+    const vector<int> document_ids(search_server.begin(), search_server.end());
+
+    vector<pair<TermSetFingerprint, int>> fingerprints(document_ids.size());
+    transform(execution::par, document_ids.begin(), document_ids.end(), fingerprints.begin(),
+              [&search_server](int document_id) {
+        TermSetFingerprint fingerprint;
+        for (const auto& [word, _] : search_server.GetWordFrequencies(document_id)) {
+            fingerprint.AddTerm(word);
         }
-        ++aux_map[document_words][document_id];
-        
-        if (aux_map[document_words].size() > 1){
-            documents_to_delete.push_back(document_id);
+        return pair{fingerprint, document_id};
+    });
+    sort(execution::par, fingerprints.begin(), fingerprints.end());
+
+    vector<int> duplicates;
+    vector<int> originals;
+    for (auto group_begin = fingerprints.begin(); group_begin != fingerprints.end();) {
+        const auto group_end = find_if(group_begin, fingerprints.end(), [group_begin](const auto& item) {
+            return item.first != group_begin->first;
+        });
+
+        // a group is ordered by id; on a hash collision it holds several distinct word sets
+        originals.clear();
+        for (auto it = group_begin; it != group_end; ++it) {
+            const auto& words = search_server.GetWordFrequencies(it->second);
+            const bool is_duplicate = any_of(originals.begin(), originals.end(), [&](int original_id) {
+                return HaveSameWords(search_server.GetWordFrequencies(original_id), words);
+            });
+            if (is_duplicate) {
+                duplicates.push_back(it->second);
+            } else {
+                originals.push_back(it->second);
+            }
         }
+        group_begin = group_end;
     }
-    
-    for (int document_id : documents_to_delete){
+
+    sort(duplicates.begin(), duplicates.end());
+    return duplicates;
+}
+
+void RemoveDuplicates(SearchServer& search_server){
+    for (int document_id : FindDuplicates(search_server)){
         cout << "Found duplicate document id "s << document_id << endl;
         search_server.RemoveDocument(document_id);
     }
 }
-
@@ -2,4 +2,8 @@
 
 #include "search_server.h"
 
+// Ids of the documents whose set of words equals that of a document with a lower id,
+// in ascending order. Fingerprints are computed in parallel and verified exactly.
+std::vector<int> FindDuplicates(const SearchServer& search_server);
+
 void RemoveDuplicates(SearchServer& search_server);
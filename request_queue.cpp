@@ -2,36 +2,181 @@
 
 using namespace std;
 
-RequestQueue::RequestQueue(const SearchServer& search_server): server_(search_server) {}
+RequestQueue::RequestQueue(const SearchServer& search_server, const RequestQueueOptions& options)
+        : server_(search_server)
+        , options_(options) {}
 
-void RequestQueue::CountEmptyRequests(const vector<Document>& result){
-    if (!requests_.empty() && time_ > min_in_day_) {
-        if(requests_.front().result.empty())
-            --empty_res_cnt_;
-
-        requests_.pop_front();
-        requests_.push_back({result});
+RequestQueue::~RequestQueue() {
+    {
+        lock_guard guard(queue_mutex_);
+        stopping_ = true;
+    }
+    has_request_.notify_all();
+    for (thread& worker : workers_) {
+        worker.join();
+    }
+}
 
-        if (result.empty())
-            ++empty_res_cnt_;
+void RequestQueue::RegisterMetrics(MetricsRegistry& registry) {
+    request_counter_ = &registry.GetCounter("request_queue_requests_total"s, "Requests executed"s);
+    empty_result_counter_ = &registry.GetCounter("request_queue_empty_results_total"s, "Requests without results"s);
+    dropped_counter_ = &registry.GetCounter("request_queue_dropped_total"s, "Requests shed or past their deadline"s);
+    metrics_registration_ = MetricsRegistration(registry);
+    metrics_registration_.AddCallbackGauge("request_queue_depth"s, "Requests waiting for a worker"s, [this] {
+        return static_cast<double>(GetQueueDepth());
+    });
+    metrics_registration_.AddCallbackGauge("request_queue_empty_result_ratio"s, "Share of empty results over the last day of requests"s, [this] {
+        const RequestWindowStats stats = GetWindowStats();
+        return stats.request_count == 0 ? 0.0 : static_cast<double>(stats.empty_count) / stats.request_count;
+    });
+}
 
-    } else{
-        requests_.push_back({result});
-        if (result.empty())
-            ++empty_res_cnt_;
+void RequestQueue::RecordResult(const vector<Document>& result, Clock::duration latency) {
+    if (request_counter_ != nullptr) {
+        request_counter_->Increment();
+        if (result.empty()) {
+            empty_result_counter_->Increment();
+        }
     }
+    lock_guard guard(stats_mutex_);
+    stats_.Record(result.empty(), chrono::duration_cast<chrono::nanoseconds>(latency));
 }
 
 int RequestQueue::GetNoResultRequests() const {
-    return empty_res_cnt_;
+    lock_guard guard(stats_mutex_);
+    return stats_.GetEmptyCount();
+}
+
+RequestWindowStats RequestQueue::GetWindowStats() const {
+    lock_guard guard(stats_mutex_);
+    return stats_.GetStats();
 }
 
 vector<Document> RequestQueue::AddFindRequest(string_view raw_query, DocumentStatus status) {
-    return AddFindRequest(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status;
-    });
+    // the server has a faster overload for a status than for an arbitrary predicate
+    return AddFindRequest<DocumentStatus>(raw_query, status);
 }
 
 vector<Document> RequestQueue::AddFindRequest(string_view raw_query) {
     return AddFindRequest(raw_query, DocumentStatus::ACTUAL);
 }
+
+future<vector<Document>> RequestQueue::Submit(string raw_query, DocumentStatus status,
+                                              int priority, Clock::time_point deadline) {
+    PendingRequest request{priority, 0, move(raw_query), status, deadline, Clock::now(), {}};
+    future<vector<Document>> result = request.promise.get_future();
+    {
+        lock_guard guard(queue_mutex_);
+        if (workers_.empty()) {
+            const size_t worker_count = max<size_t>(options_.worker_count, 1);
+            for (size_t i = 0; i < worker_count; ++i) {
+                workers_.emplace_back([this] {
+                    WorkerLoop();
+                });
+            }
+        }
+
+        request.sequence = next_sequence_++;
+        Enqueue(move(request));
+    }
+    has_request_.notify_one();
+    return result;
+}
+
+future<vector<Document>> RequestQueue::Submit(string raw_query, int priority, Clock::time_point deadline) {
+    return Submit(move(raw_query), DocumentStatus::ACTUAL, priority, deadline);
+}
+
+size_t RequestQueue::GetQueueDepth() const {
+    lock_guard guard(queue_mutex_);
+    return pending_.size();
+}
+
+size_t RequestQueue::GetDroppedRequests() const {
+    lock_guard guard(queue_mutex_);
+    return dropped_cnt_;
+}
+
+RequestQueue::Clock::duration RequestQueue::GetAverageWaitTime() const {
+    lock_guard guard(queue_mutex_);
+    if (executed_cnt_ == 0) {
+        return Clock::duration::zero();
+    }
+    return total_wait_ / executed_cnt_;
+}
+
+void RequestQueue::Enqueue(PendingRequest request) {
+    if (pending_.size() >= options_.max_queue_depth) {
+        // shed the lowest ranked request, which may be this one
+        if (pending_.empty() || PendingRequestOrder{}(*prev(pending_.end()), request)) {
+            Drop(request, "Request queue is full");
+            return;
+        }
+        auto node = pending_.extract(prev(pending_.end()));
+        Drop(node.value(), "Request was shed by a higher priority request");
+    }
+    pending_.insert(move(request));
+}
+
+void RequestQueue::Drop(PendingRequest& request, const char* reason) {
+    ++dropped_cnt_;
+    if (dropped_counter_ != nullptr) {
+        dropped_counter_->Increment();
+    }
+    request.promise.set_exception(make_exception_ptr(RequestDropped(reason)));
+}
+
+void RequestQueue::WorkerLoop() {
+    vector<PendingRequest> batch;
+    batch.reserve(options_.batch_size);
+    while (true) {
+        {
+            unique_lock lock(queue_mutex_);
+            has_request_.wait(lock, [this] {
+                return stopping_ || !pending_.empty();
+            });
+            if (pending_.empty()) {
+                return;
+            }
+            while (!pending_.empty() && batch.size() < max<size_t>(options_.batch_size, 1)) {
+                batch.push_back(move(pending_.extract(pending_.begin()).value()));
+            }
+        }
+
+        bool returned_requests = false;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            PendingRequest& request = batch[i];
+            {
+                lock_guard guard(queue_mutex_);
+                // a more urgent request arrived after the batch was taken
+                if (i > 0 && !pending_.empty() && PendingRequestOrder{}(*pending_.begin(), request)) {
+                    // the returned requests count against the depth limit like new ones
+                    for (; i < batch.size(); ++i) {
+                        Enqueue(move(batch[i]));
+                    }
+                    returned_requests = true;
+                    break;
+                }
+                const Clock::time_point now = Clock::now();
+                if (request.deadline < now) {
+                    Drop(request, "Request missed its deadline");
+                    continue;
+                }
+                total_wait_ += now - request.enqueued;
+                ++executed_cnt_;
+            }
+            try {
+                const Clock::time_point start = Clock::now();
+                vector<Document> result = server_.FindTopDocuments(std::execution::seq, request.raw_query, request.status);
+                RecordResult(result, Clock::now() - start);
+                request.promise.set_value(move(result));
+            } catch (...) {
+                request.promise.set_exception(current_exception());
+            }
+        }
+        batch.clear();
+        if (returned_requests) {
+            has_request_.notify_all();
+        }
+    }
+}
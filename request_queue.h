@@ -1,14 +1,38 @@
 #pragma once
 
-#include <deque>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <set>
+#include <stdexcept>
+#include <thread>
 
 #include "search_server.h"
+#include "request_stats.h"
+
+struct RequestQueueOptions {
+    // Workers are started by the first Submit. They share the cores with the async
+    // searches of the server, so the caller sizes both together.
+    size_t worker_count = 1;
+    // requests above this depth are shed, lowest priority first
+    size_t max_queue_depth = 1024;
+    // Number of requests a worker takes from the queue under one lock. Before each one it
+    // runs, the worker hands the rest back if a more urgent request has arrived.
+    size_t batch_size = 4;
+};
+
+// Delivered through the future of a request that was shed or missed its deadline.
+class RequestDropped : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
 
 class RequestQueue {
 public:
-    explicit RequestQueue(const SearchServer& search_server);
+    using Clock = std::chrono::steady_clock;
 
-    void CountEmptyRequests(const std::vector<Document>& result);
+    explicit RequestQueue(const SearchServer& search_server, const RequestQueueOptions& options = {});
+    ~RequestQueue();
 
     template <typename DocumentPredicate>
     std::vector<Document> AddFindRequest(std::string_view raw_query, DocumentPredicate document_predicate);
@@ -16,23 +40,77 @@ public:
     std::vector<Document> AddFindRequest(std::string_view raw_query, DocumentStatus status);
     std::vector<Document> AddFindRequest(std::string_view raw_query);
 
+    // Thread-safe. Higher priority is served first; requests still queued at their
+    // deadline are dropped with RequestDropped instead of being executed.
+    std::future<std::vector<Document>> Submit(std::string raw_query, DocumentStatus status,
+                                              int priority, Clock::time_point deadline);
+    std::future<std::vector<Document>> Submit(std::string raw_query, int priority, Clock::time_point deadline);
+
+    // Counts requests, empty results and drops in registry. Call before the first request;
+    // the registry must outlive the queue. The gauges reading the queue are removed when
+    // the queue is destroyed.
+    void RegisterMetrics(MetricsRegistry& registry);
+
     int GetNoResultRequests() const;
+    // request count, empty count and latency percentiles over the last day of requests
+    RequestWindowStats GetWindowStats() const;
+    size_t GetQueueDepth() const;
+    size_t GetDroppedRequests() const;
+    Clock::duration GetAverageWaitTime() const;
     
 private:
-    struct QueryResult {
-        std::vector<Document> result;
+    struct PendingRequest {
+        int priority;
+        uint64_t sequence;
+        std::string raw_query;
+        DocumentStatus status;
+        Clock::time_point deadline;
+        Clock::time_point enqueued;
+        std::promise<std::vector<Document>> promise;
     };
-    std::deque<QueryResult> requests_;
+
+    struct PendingRequestOrder {
+        bool operator()(const PendingRequest& lhs, const PendingRequest& rhs) const {
+            if (lhs.priority != rhs.priority) {
+                return lhs.priority > rhs.priority;
+            }
+            return lhs.sequence < rhs.sequence;
+        }
+    };
+
     const static int min_in_day_ = 1440;
+    const static int hours_in_day_ = 24;
     const SearchServer& server_;
-    int empty_res_cnt_ = 0;
-    int time_ = 0;
+    RequestStatsWindow<min_in_day_, hours_in_day_> stats_;
+    mutable std::mutex stats_mutex_;
+
+    const RequestQueueOptions options_;
+    std::multiset<PendingRequest, PendingRequestOrder> pending_;
+    uint64_t next_sequence_ = 0;
+    size_t dropped_cnt_ = 0;
+    size_t executed_cnt_ = 0;
+    Clock::duration total_wait_ = Clock::duration::zero();
+    bool stopping_ = false;
+    mutable std::mutex queue_mutex_;
+    std::condition_variable has_request_;
+    std::vector<std::thread> workers_;
+
+    Counter* request_counter_ = nullptr;
+    Counter* empty_result_counter_ = nullptr;
+    Counter* dropped_counter_ = nullptr;
+    MetricsRegistration metrics_registration_;
+
+    void RecordResult(const std::vector<Document>& result, Clock::duration latency);
+    // inserts request, shedding the lowest ranked request if the queue is full; call under queue_mutex_
+    void Enqueue(PendingRequest request);
+    void Drop(PendingRequest& request, const char* reason);
+    void WorkerLoop();
 };
 
 template <typename DocumentPredicate>
 std::vector<Document> RequestQueue::AddFindRequest(std::string_view raw_query, DocumentPredicate document_predicate) {
+    const Clock::time_point start = Clock::now();
     const std::vector<Document> result = server_.FindTopDocuments(std::execution::seq, raw_query, document_predicate);
-    ++time_;
-    CountEmptyRequests(result);
+    RecordResult(result, Clock::now() - start);
     return result;
-}
\ No newline at end of file
+}
@@ -0,0 +1,68 @@
+#include "request_stats.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+int LatencyHistogram::BucketIndex(uint64_t value) {
+    if (value < sub_bucket_cnt_) {
+        return static_cast<int>(value);
+    }
+    int high_bit = 63;
+    while ((value >> high_bit) == 0) {
+        --high_bit;
+    }
+    if (high_bit >= max_value_bits_) {
+        return bucket_cnt_ - 1;
+    }
+    const int shift = high_bit - sub_bucket_bits_;
+    const int sub_bucket = static_cast<int>(value >> shift) - sub_bucket_cnt_;
+    return (shift + 1) * sub_bucket_cnt_ + sub_bucket;
+}
+
+uint64_t LatencyHistogram::BucketMidpoint(int index) {
+    if (index < sub_bucket_cnt_) {
+        return index;
+    }
+    const int shift = index / sub_bucket_cnt_ - 1;
+    const uint64_t low = static_cast<uint64_t>(sub_bucket_cnt_ + index % sub_bucket_cnt_) << shift;
+    return low + ((uint64_t{1} << shift) >> 1);
+}
+
+void LatencyHistogram::Record(chrono::nanoseconds latency) {
+    ++counts_[BucketIndex(static_cast<uint64_t>(max<int64_t>(latency.count(), 0)))];
+    ++total_cnt_;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (int i = 0; i < bucket_cnt_; ++i) {
+        counts_[i] += other.counts_[i];
+    }
+    total_cnt_ += other.total_cnt_;
+}
+
+void LatencyHistogram::Clear() {
+    counts_.fill(0);
+    total_cnt_ = 0;
+}
+
+uint64_t LatencyHistogram::GetCount() const {
+    return total_cnt_;
+}
+
+chrono::nanoseconds LatencyHistogram::GetPercentile(double percentile) const {
+    if (total_cnt_ == 0) {
+        return chrono::nanoseconds::zero();
+    }
+    const double clamped = clamp(percentile, 0.0, 100.0);
+    const uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(ceil(clamped / 100 * total_cnt_)));
+    uint64_t seen = 0;
+    for (int i = 0; i < bucket_cnt_; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return chrono::nanoseconds(BucketMidpoint(i));
+        }
+    }
+    return chrono::nanoseconds(BucketMidpoint(bucket_cnt_ - 1));
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+
+// HDR-style latency histogram: nanosecond values are grouped by their highest bit
+// and every power-of-two range is split into linear sub-buckets, so percentiles
+// carry at most ~6% relative error while the memory stays fixed.
+class LatencyHistogram {
+public:
+    void Record(std::chrono::nanoseconds latency);
+    void Merge(const LatencyHistogram& other);
+    void Clear();
+
+    uint64_t GetCount() const;
+    // percentile is in [0, 100]; returns the midpoint of the bucket holding it
+    std::chrono::nanoseconds GetPercentile(double percentile) const;
+
+private:
+    static const int sub_bucket_bits_ = 4;
+    static const int sub_bucket_cnt_ = 1 << sub_bucket_bits_;
+    // values of 2^40 ns (about 18 minutes) and above share the last bucket
+    static const int max_value_bits_ = 40;
+    static const int bucket_cnt_ = (max_value_bits_ - sub_bucket_bits_ + 1) * sub_bucket_cnt_;
+
+    static int BucketIndex(uint64_t value);
+    static uint64_t BucketMidpoint(int index);
+
+    std::array<uint32_t, bucket_cnt_> counts_{};
+    uint64_t total_cnt_ = 0;
+};
+
+struct RequestWindowStats {
+    int request_count = 0;
+    int empty_count = 0;
+    std::chrono::nanoseconds p50{0};
+    std::chrono::nanoseconds p95{0};
+    std::chrono::nanoseconds p99{0};
+};
+
+// Statistics over the last window_size requests, where every request advances the
+// clock by one minute. Empty results are kept per minute, which keeps the counts
+// exact; latencies are aggregated per slot of window_size / slot_count minutes,
+// so the percentiles cover the window in whole slots.
+template <int window_size, int slot_count>
+class RequestStatsWindow {
+public:
+    static_assert(window_size % slot_count == 0, "Window must consist of whole slots");
+
+    void Record(bool empty_result, std::chrono::nanoseconds latency) {
+        const int minute = static_cast<int>(time_ % window_size);
+        if (time_ >= window_size && empty_minutes_[minute]) {
+            --empty_cnt_;
+        }
+        empty_minutes_[minute] = empty_result;
+        if (empty_result) {
+            ++empty_cnt_;
+        }
+
+        LatencyHistogram& slot = slots_[minute / slot_size_];
+        if (minute % slot_size_ == 0) {
+            slot.Clear();
+        }
+        slot.Record(latency);
+        ++time_;
+    }
+
+    int GetEmptyCount() const {
+        return empty_cnt_;
+    }
+
+    RequestWindowStats GetStats() const {
+        RequestWindowStats stats;
+        LatencyHistogram latencies;
+        for (const LatencyHistogram& slot : slots_) {
+            latencies.Merge(slot);
+        }
+        stats.request_count = static_cast<int>(std::min<uint64_t>(time_, window_size));
+        stats.empty_count = empty_cnt_;
+        stats.p50 = latencies.GetPercentile(50);
+        stats.p95 = latencies.GetPercentile(95);
+        stats.p99 = latencies.GetPercentile(99);
+        return stats;
+    }
+
+private:
+    static const int slot_size_ = window_size / slot_count;
+
+    uint64_t time_ = 0;
+    int empty_cnt_ = 0;
+    std::bitset<window_size> empty_minutes_;
+    std::array<LatencyHistogram, slot_count> slots_;
+};
@@ -0,0 +1,45 @@
+#include "score_accumulator.h"
+
+#include <algorithm>
+
+using namespace std;
+
+ScoreAccumulator::Lease::Lease(size_t ordinal_count)
+        : accumulator_(&ForThisThread()) {
+    if (accumulator_->leased_) {
+        private_accumulator_ = make_unique<ScoreAccumulator>();
+        accumulator_ = private_accumulator_.get();
+    }
+    accumulator_->leased_ = true;
+    accumulator_->Reset(ordinal_count);
+}
+
+ScoreAccumulator::Lease::~Lease() {
+    accumulator_->leased_ = false;
+}
+
+ScoreAccumulator& ScoreAccumulator::Lease::operator*() const {
+    return *accumulator_;
+}
+
+ScoreAccumulator* ScoreAccumulator::Lease::operator->() const {
+    return accumulator_;
+}
+
+ScoreAccumulator& ScoreAccumulator::ForThisThread() {
+    thread_local ScoreAccumulator accumulator;
+    return accumulator;
+}
+
+void ScoreAccumulator::Reset(size_t ordinal_count) {
+    touched_.clear();
+    if (++epoch_ == 0) {
+        // after a wrap-around old tags could match again
+        fill(epochs_.begin(), epochs_.end(), 0);
+        epoch_ = 1;
+    }
+    if (epochs_.size() < ordinal_count) {
+        epochs_.resize(ordinal_count, 0);
+        scores_.resize(ordinal_count);
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Dense per-thread array of document scores for term-at-a-time scoring, indexed by the
+// internal ordinal of a document. A score belongs to the current search only when its
+// epoch tag matches, so starting a search costs nothing and reading the results back
+// costs O(touched documents).
+class ScoreAccumulator {
+public:
+    // Borrows the accumulator of this thread and starts a new search in it. A search
+    // nested in another one on the same thread, e.g. from a document predicate, gets a
+    // private accumulator instead.
+    class Lease {
+    public:
+        explicit Lease(size_t ordinal_count);
+        ~Lease();
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        ScoreAccumulator& operator*() const;
+        ScoreAccumulator* operator->() const;
+
+    private:
+        std::unique_ptr<ScoreAccumulator> private_accumulator_;
+        ScoreAccumulator* accumulator_;
+    };
+
+    void Add(uint32_t ordinal, double score) {
+        if (epochs_[ordinal] != epoch_) {
+            epochs_[ordinal] = epoch_;
+            scores_[ordinal] = 0.0;
+            touched_.push_back(ordinal);
+        }
+        scores_[ordinal] += score;
+    }
+
+    // returns whether the ordinal had a score
+    bool Remove(uint32_t ordinal) {
+        if (epochs_[ordinal] != epoch_) {
+            return false;
+        }
+        epochs_[ordinal] = 0;
+        return true;
+    }
+
+    // documents scored so far, including removed ones
+    size_t GetTouchedCount() const {
+        return touched_.size();
+    }
+
+    // calls function(ordinal, score) for every remaining document in the order of first touch
+    template <typename Function>
+    void ForEachScore(Function function) const {
+        for (const uint32_t ordinal : touched_) {
+            if (epochs_[ordinal] == epoch_) {
+                function(ordinal, scores_[ordinal]);
+            }
+        }
+    }
+
+private:
+    std::vector<double> scores_;
+    // epoch 0 marks a score of no search
+    std::vector<uint32_t> epochs_;
+    std::vector<uint32_t> touched_;
+    uint32_t epoch_ = 0;
+    bool leased_ = false;
+
+    static ScoreAccumulator& ForThisThread();
+    void Reset(size_t ordinal_count);
+};
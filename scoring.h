@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+// Scoring policies for SearchServer::FindTopDocuments. The relevance of a document is the sum
+// of TermScore over the query words it contains. term_freq is the number of occurrences of the
+// word divided by document_length, the number of non-stop words in the document.
+// A policy that sets uses_document_length to false is never given the real document length,
+// which spares loading it for every posting.
+
+// The original relevance: normalized term frequency times log(N / df).
+struct TfIdfScoring {
+    static constexpr bool uses_document_length = false;
+
+    double InverseDocumentFreq(int document_count, size_t document_freq) const {
+        return std::log(document_count * 1.0 / document_freq);
+    }
+
+    double TermScore(double term_freq, double inverse_document_freq,
+                     int /*document_length*/, double /*average_document_length*/) const {
+        return term_freq * inverse_document_freq;
+    }
+};
+
+// Okapi BM25 with the usual k1 and b parameters.
+struct Bm25Scoring {
+    static constexpr bool uses_document_length = true;
+
+    double k1 = 1.2;
+    double b = 0.75;
+
+    double InverseDocumentFreq(int document_count, size_t document_freq) const {
+        return std::log(1.0 + (document_count - document_freq + 0.5) / (document_freq + 0.5));
+    }
+
+    double TermScore(double term_freq, double inverse_document_freq,
+                     int document_length, double average_document_length) const {
+        const double occurrences = term_freq * document_length;
+        const double length_norm = k1 * (1.0 - b + b * document_length / average_document_length);
+        return inverse_document_freq * occurrences * (k1 + 1.0) / (occurrences + length_norm);
+    }
+};
@@ -2,64 +2,299 @@
 
 using namespace std;
 
-SearchServer::SearchServer(const string& stop_words_text): SearchServer::SearchServer(SplitIntoWordsView(stop_words_text)){}
-SearchServer::SearchServer(const string_view stop_words_text): SearchServer::SearchServer(SplitIntoWordsView(stop_words_text)){}
+SearchServer::SearchServer(const string& stop_words_text, pmr::memory_resource* resource): SearchServer::SearchServer(SplitIntoWordsView(stop_words_text), resource){}
+SearchServer::SearchServer(const string_view stop_words_text, pmr::memory_resource* resource): SearchServer::SearchServer(SplitIntoWordsView(stop_words_text), resource){}
 
 void SearchServer::AddDocument(int document_id, const string_view document, DocumentStatus status, const vector<int>& ratings){
     if ((document_id < 0) || (documents_.count(document_id) > 0)) {
         throw invalid_argument("Invalid document_id"s);
     }
 
-    const auto [it, inserted] = documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status, string(document)});
+    const auto words = SplitIntoWordsNoStop(document);
 
-    const auto words = SplitIntoWordsNoStop(it->second.content);
+    TermSetFingerprint fingerprint;
+    if (duplicate_ingest_mode_ != DuplicateIngestMode::ALLOW) {
+        vector<string_view> sorted_words = words;
+        sort(sorted_words.begin(), sorted_words.end());
+        sorted_words.erase(unique(sorted_words.begin(), sorted_words.end()), sorted_words.end());
+        fingerprint = ComputeTermSetFingerprint(sorted_words);
+
+        const int original_id = FindDocumentWithWords(fingerprint, sorted_words);
+        if (original_id >= 0) {
+            if (duplicate_ingest_mode_ == DuplicateIngestMode::REJECT) {
+                throw invalid_argument("Document "s + to_string(document_id) + " duplicates document "s + to_string(original_id));
+            }
+            cout << "Found duplicate document id "s << document_id << endl;
+            return;
+        }
+        fingerprint_to_documents_[fingerprint].push_back(document_id);
+    }
+
+    const uint32_t ordinal = AcquireOrdinal(document_id, static_cast<int>(words.size()));
+    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status, string(document),
+                                                 static_cast<int>(words.size()), fingerprint, ordinal});
     document_ids_.push_back(document_id);
+    total_document_length_ += words.size();
+    status_to_documents_[static_cast<size_t>(status)].Set(ordinal);
+    rating_index_.emplace(documents_.at(document_id).rating, document_id);
+    ++rating_to_document_count_[documents_.at(document_id).rating];
 
     const double inv_word_count = 1.0 / words.size();
+    WordFrequencies& word_freqs = document_to_word_freqs_[document_id];
     for (const string_view word : words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][word] += inv_word_count;
+        word_freqs[InternWord(word)] += inv_word_count;
+    }
+    // postings are written once the frequencies are complete, as they may be quantized
+    for (const auto& [word, term_freq] : word_freqs) {
+        auto& postings = word_to_document_freqs_[word];
+        postings[document_id] = {TermFreqCodec::Encode(term_freq), ordinal};
+        max_posting_list_size_ = max(max_posting_list_size_, postings.size());
+    }
+    posting_count_ += word_freqs.size();
+    if (store_positions_) {
+        AddWordPositions(document_id, words);
     }
 }
 
-int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+void SearchServer::SetStorePositions(bool store_positions) {
+    if (store_positions && !store_positions_) {
+        for (const auto& [document_id, document_data] : documents_) {
+            AddWordPositions(document_id, SplitIntoWordsNoStop(document_data.content));
+        }
+    } else if (!store_positions) {
+        document_to_word_positions_.clear();
+    }
+    store_positions_ = store_positions;
 }
 
-vector<int>::const_iterator SearchServer::begin() const {
-    return document_ids_.begin();
+void SearchServer::AddWordPositions(int document_id, const vector<string_view>& words) {
+    auto& word_positions = document_to_word_positions_[document_id];
+    for (size_t position = 0; position < words.size(); ++position) {
+        // the word is already in the dictionary, so the key does not point into the document
+        word_positions[*words_.find(words[position])].Add(static_cast<uint32_t>(position));
+    }
 }
 
-vector<int>::const_iterator SearchServer::end() const {
-    return document_ids_.end();
-}
+bool SearchServer::ContainsPhrase(int document_id, const pmr::vector<string_view>& phrase) const {
+    const auto word_positions = document_to_word_positions_.find(document_id);
+    if (word_positions == document_to_word_positions_.end()) {
+        return false;
+    }
 
-tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(
-        string_view raw_query, int document_id) const {
+    // start positions of the phrase prefix matched so far
+    vector<uint32_t> starts;
+    for (size_t offset = 0; offset < phrase.size(); ++offset) {
+        const auto positions = word_positions->second.find(phrase[offset]);
+        if (positions == word_positions->second.end()) {
+            return false;
+        }
+        const vector<uint32_t> word_positions_list = positions->second.Decode();
+        if (offset == 0) {
+            starts = word_positions_list;
+            continue;
+        }
 
-    const Query query = ParseQuery(raw_query, true);
+        auto word_it = word_positions_list.begin();
+        const auto last = remove_if(starts.begin(), starts.end(), [&](uint32_t start) {
+            const uint32_t expected = start + static_cast<uint32_t>(offset);
+            word_it = lower_bound(word_it, word_positions_list.end(), expected);
+            return word_it == word_positions_list.end() || *word_it != expected;
+        });
+        starts.erase(last, starts.end());
+        if (starts.empty()) {
+            return false;
+        }
+    }
+    return !starts.empty();
+}
 
-    for (string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+void SearchServer::SetDuplicateIngestMode(DuplicateIngestMode mode) {
+    if (mode == DuplicateIngestMode::ALLOW) {
+        fingerprint_to_documents_.clear();
+    } else if (duplicate_ingest_mode_ == DuplicateIngestMode::ALLOW) {
+        for (auto& [document_id, document_data] : documents_) {
+            TermSetFingerprint fingerprint;
+            for (const auto& [word, _] : GetWordFrequencies(document_id)) {
+                fingerprint.AddTerm(word);
+            }
+            document_data.fingerprint = fingerprint;
+            fingerprint_to_documents_[fingerprint].push_back(document_id);
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            return { vector<string_view>{}, documents_.at(document_id).status };
+    }
+    duplicate_ingest_mode_ = mode;
+}
+
+int SearchServer::FindDocumentWithWords(const TermSetFingerprint& fingerprint, const vector<string_view>& sorted_words) const {
+    const auto candidates = fingerprint_to_documents_.find(fingerprint);
+    if (candidates == fingerprint_to_documents_.end()) {
+        return -1;
+    }
+    // equal fingerprints are verified word by word in case of a hash collision
+    for (const int candidate_id : candidates->second) {
+        const auto& word_freqs = GetWordFrequencies(candidate_id);
+        if (word_freqs.size() == sorted_words.size()
+            && equal(sorted_words.begin(), sorted_words.end(), word_freqs.begin(),
+                     [](string_view word, const auto& word_freq) {
+                         return word == word_freq.first;
+                     })) {
+            return candidate_id;
         }
     }
+    return -1;
+}
 
+void SearchServer::RemoveFingerprint(int document_id) {
+    if (duplicate_ingest_mode_ == DuplicateIngestMode::ALLOW) {
+        return;
+    }
+    const auto candidates = fingerprint_to_documents_.find(documents_.at(document_id).fingerprint);
+    auto& ids = candidates->second;
+    ids.erase(find(ids.begin(), ids.end(), document_id));
+    if (ids.empty()) {
+        fingerprint_to_documents_.erase(candidates);
+    }
+}
 
-    vector<string_view> matched_words;
-    for (const string_view& word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+void SearchServer::SetAsyncThreadCount(size_t thread_count) {
+    lock_guard guard(async_state_->mutex);
+    // the old pool drains its queue in the destructor, so no submitted search is lost
+    async_state_->thread_pool.reset();
+    async_state_->thread_count = thread_count;
+}
+
+ThreadPool& SearchServer::GetThreadPool() const {
+    lock_guard guard(async_state_->mutex);
+    if (!async_state_->thread_pool) {
+        async_state_->thread_pool = make_unique<ThreadPool>(async_state_->thread_count);
+    }
+    return *async_state_->thread_pool;
+}
+
+int SearchServer::GetDocumentCount() const {
+    return documents_.size();
+}
+
+void SearchServer::RegisterMetrics(MetricsRegistry& registry) {
+    query_counter_ = &registry.GetCounter("search_server_queries_total"s, "Searches executed"s);
+    query_latency_ = &registry.GetHistogram("search_server_query_latency_seconds"s, "Search latency"s, MakeLatencyBuckets());
+    metrics_registration_ = MetricsRegistration(registry);
+    metrics_registration_.AddCallbackGauge("search_server_documents"s, "Indexed documents"s, [this] {
+        return static_cast<double>(documents_.size());
+    });
+    metrics_registration_.AddCallbackGauge("search_server_words"s, "Distinct indexed words"s, [this] {
+        return static_cast<double>(word_to_document_freqs_.size());
+    });
+    metrics_registration_.AddCallbackGauge("search_server_postings"s, "Postings in all posting lists"s, [this] {
+        return static_cast<double>(posting_count_);
+    });
+    metrics_registration_.AddCallbackGauge("search_server_max_posting_list_size"s, "Postings of the most frequent word"s, [this] {
+        if (max_posting_list_size_stale_) {
+            max_posting_list_size_ = 0;
+            for (const auto& [word, postings] : word_to_document_freqs_) {
+                max_posting_list_size_ = max(max_posting_list_size_, postings.size());
+            }
+            max_posting_list_size_stale_ = false;
+        }
+        return static_cast<double>(max_posting_list_size_);
+    });
+
+    const pair<string, size_t IndexMemoryUsage::*> memory_components[] = {
+            {"dictionary"s, &IndexMemoryUsage::dictionary},
+            {"postings"s, &IndexMemoryUsage::postings},
+            {"forward_index"s, &IndexMemoryUsage::forward_index},
+            {"document_contents"s, &IndexMemoryUsage::document_contents},
+            {"attributes"s, &IndexMemoryUsage::attributes},
+            {"positions"s, &IndexMemoryUsage::positions},
+    };
+    vector<pair<string, string>> memory_gauges;
+    vector<size_t IndexMemoryUsage::*> memory_fields;
+    for (const auto& [component, field] : memory_components) {
+        memory_gauges.emplace_back("search_server_memory_"s + component + "_bytes"s, "Estimated heap bytes of the "s + component);
+        memory_fields.push_back(field);
+    }
+    memory_gauges.emplace_back("search_server_memory_bytes"s, "Estimated heap bytes of the index"s);
+    // one walk of the index per dump for all of them
+    metrics_registration_.AddCallbackGauges(memory_gauges, [this, memory_fields] {
+        const IndexMemoryUsage usage = MemoryUsage();
+        vector<double> values;
+        for (const auto field : memory_fields) {
+            values.push_back(static_cast<double>(usage.*field));
+        }
+        values.push_back(static_cast<double>(usage.GetTotal()));
+        return values;
+    });
+}
+
+IndexMemoryUsage SearchServer::MemoryUsage() const {
+    IndexMemoryUsage usage;
+
+    for (const auto* words : {&stop_words_, &words_}) {
+        usage.dictionary += EstimateTreeNodeBytes(*words);
+        for (const string& word : *words) {
+            usage.dictionary += EstimateStringBytes(word);
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.push_back(word);
+    }
+
+    // a caller-supplied resource is assumed to allocate like malloc
+    const auto estimate_index_allocation = owned_resource_ ? EstimatePoolAllocation : EstimateAllocation;
+    usage.postings = EstimateTreeNodeBytes(word_to_document_freqs_, estimate_index_allocation);
+    for (const auto& [word, postings] : word_to_document_freqs_) {
+        usage.postings += EstimateTreeNodeBytes(postings, estimate_index_allocation);
+    }
+
+    usage.forward_index = EstimateTreeNodeBytes(document_to_word_freqs_, estimate_index_allocation);
+    for (const auto& [document_id, word_freqs] : document_to_word_freqs_) {
+        usage.forward_index += EstimateTreeNodeBytes(word_freqs, estimate_index_allocation);
+    }
+
+    usage.attributes = EstimateTreeNodeBytes(documents_) + EstimateVectorBytes(document_ids_)
+                       + EstimateVectorBytes(ordinal_to_document_id_) + EstimateVectorBytes(ordinal_to_document_length_)
+                       + EstimateVectorBytes(free_ordinals_)
+                       + EstimateTreeNodeBytes(rating_index_) + EstimateTreeNodeBytes(rating_to_document_count_)
+                       + EstimateHashTableBytes(fingerprint_to_documents_);
+    for (const auto& [document_id, document_data] : documents_) {
+        usage.document_contents += EstimateStringBytes(document_data.content);
+    }
+    for (const DocumentBitmap& documents : status_to_documents_) {
+        usage.attributes += documents.GetCapacityBytes() == 0 ? 0 : EstimateAllocation(documents.GetCapacityBytes());
+    }
+    for (const auto& [fingerprint, document_ids] : fingerprint_to_documents_) {
+        usage.attributes += EstimateVectorBytes(document_ids);
+    }
+
+    usage.positions = EstimateTreeNodeBytes(document_to_word_positions_);
+    for (const auto& [document_id, word_positions] : document_to_word_positions_) {
+        usage.positions += EstimateTreeNodeBytes(word_positions);
+        for (const auto& [word, positions] : word_positions) {
+            usage.positions += positions.GetCapacityBytes() == 0 ? 0 : EstimateAllocation(positions.GetCapacityBytes());
         }
     }
+    return usage;
+}
+
+chrono::steady_clock::time_point SearchServer::GetQueryStartTime() const {
+    return query_counter_ == nullptr ? chrono::steady_clock::time_point() : chrono::steady_clock::now();
+}
+
+void SearchServer::RecordQueryMetrics(chrono::steady_clock::time_point start_time) const {
+    if (query_counter_ == nullptr) {
+        return;
+    }
+    query_counter_->Increment();
+    query_latency_->Observe(chrono::duration<double>(chrono::steady_clock::now() - start_time).count());
+}
+
+vector<int>::const_iterator SearchServer::begin() const {
+    return document_ids_.begin();
+}
+
+vector<int>::const_iterator SearchServer::end() const {
+    return document_ids_.end();
+}
 
-    return {matched_words, documents_.at(document_id).status};
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(
+        string_view raw_query, int document_id) const {
+    return MatchParsedQuery(ParseQuery(raw_query, true), document_id);
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(
@@ -71,24 +306,71 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(
         execution::parallel_policy ex_policy, string_view raw_query, int document_id) const{
 
+    const DocumentStatus status = documents_.at(document_id).status;
     const Query query = ParseQuery(raw_query, false);
 
-    if(any_of(query.minus_words.begin(), query.minus_words.end(), [this, document_id](const string_view& word){
-        return word_to_document_freqs_.at(word).count(document_id);
-    })) {
-        return {vector<string_view>(), documents_.at(document_id).status};
+    const auto& word_freqs = GetWordFrequencies(document_id);
+    const auto is_in_document = [&word_freqs](string_view word) {
+        return word_freqs.count(word) > 0;
+    };
+
+    if(any_of(ex_policy, query.minus_words.begin(), query.minus_words.end(), is_in_document)) {
+        return {vector<string_view>(), status};
     }
 
+    // the views point into the dictionary rather than into raw_query, as in MatchParsedQuery;
+    // an empty view marks a word the document lacks, query words are never empty
     vector<string_view> matched_words(query.plus_words.size());
-    copy_if(ex_policy, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(),
-                      [this, document_id](const string_view& word){
-        return word_to_document_freqs_.at(word).count(document_id);
-    });
+    transform(ex_policy, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(),
+              [&word_freqs](string_view word) {
+                  const auto word_it = word_freqs.find(word);
+                  return word_it == word_freqs.end() ? string_view() : word_it->first;
+              });
+    matched_words.erase(remove(matched_words.begin(), matched_words.end(), string_view()), matched_words.end());
     sort(ex_policy, matched_words.begin(), matched_words.end());
-    auto it = unique(matched_words.begin(), matched_words.end());
+    matched_words.erase(unique(matched_words.begin(), matched_words.end()), matched_words.end());
 
+    return {matched_words, status};
+}
 
-    return {{matched_words.begin(), it-1}, documents_.at(document_id).status};
+vector<tuple<vector<string_view>, DocumentStatus>> SearchServer::MatchDocuments(
+        string_view raw_query, const vector<int>& document_ids) const {
+    return MatchDocuments(execution::seq, raw_query, document_ids);
+}
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchParsedQuery(const Query& query, int document_id) const {
+    const DocumentStatus status = documents_.at(document_id).status;
+    const auto& word_freqs = GetWordFrequencies(document_id);
+
+    // both sides are sorted, so matching is a single merge pass per word list
+    auto word_it = word_freqs.begin();
+    for (const string_view word : query.minus_words) {
+        while (word_it != word_freqs.end() && word_it->first < word) {
+            ++word_it;
+        }
+        if (word_it == word_freqs.end()) {
+            break;
+        }
+        if (word_it->first == word) {
+            return {vector<string_view>{}, status};
+        }
+    }
+
+    vector<string_view> matched_words;
+    word_it = word_freqs.begin();
+    for (const string_view word : query.plus_words) {
+        while (word_it != word_freqs.end() && word_it->first < word) {
+            ++word_it;
+        }
+        if (word_it == word_freqs.end()) {
+            break;
+        }
+        if (word_it->first == word) {
+            matched_words.push_back(word_it->first);
+        }
+    }
+
+    return {matched_words, status};
 }
 
 bool SearchServer::IsStopWord(string_view word) const {
@@ -135,18 +417,97 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
     return {text, is_minus, IsStopWord(text)};
 }
 
-SearchServer::Query SearchServer::ParseQuery(string_view text, const bool s) const {
-    Query result;
-    for (string_view word : SplitIntoWordsView(text)) {
+size_t SearchServer::FindFuzzyMark(string_view word) {
+    if (word.size() > 1 && word.back() == '~') {
+        return word.size() - 1;
+    }
+    if (word.size() > 2 && word[word.size() - 2] == '~' && word.back() >= '0' && word.back() <= '9') {
+        return word.size() - 2;
+    }
+    return string_view::npos;
+}
+
+SearchServer::Query SearchServer::ParseQuery(string_view text, const bool s, pmr::memory_resource* resource) const {
+    PROFILE_SCOPE("ParseQuery");
+    Query result(resource);
+    // fuzzy expansions that are also plain plus words keep the full weight
+    pmr::set<string_view> exact_plus_words(resource);
+    bool in_phrase = false;
+    for (string_view word : SplitIntoWordsView(text, resource)) {
+        if (!in_phrase && !word.empty() && word.front() == '"') {
+            in_phrase = true;
+            result.phrases.emplace_back();
+            word.remove_prefix(1);
+        }
+        if (!in_phrase) {
+            const auto query_word = ParseQueryWord(word);
+            if (!query_word.is_stop) {
+                auto& words = query_word.is_minus ? result.minus_words : result.plus_words;
+                const size_t fuzzy_mark = FindFuzzyMark(query_word.data);
+                if (query_word.data.size() > 1 && query_word.data.back() == '*') {
+                    const size_t first_expansion = words.size();
+                    ExpandPrefix(query_word.data.substr(0, query_word.data.size() - 1), words);
+                    exact_plus_words.insert(words.begin() + first_expansion, words.end());
+                } else if (fuzzy_mark != string_view::npos) {
+                    int max_distance = 1;
+                    if (fuzzy_mark + 1 < query_word.data.size()) {
+                        max_distance = query_word.data.back() - '0';
+                        if (max_distance > MAX_FUZZY_EDIT_DISTANCE) {
+                            throw invalid_argument("Fuzzy edit distance must be at most "s + to_string(MAX_FUZZY_EDIT_DISTANCE));
+                        }
+                    }
+                    ExpandFuzzy(query_word.data.substr(0, fuzzy_mark), max_distance, [&](string_view word, int distance) {
+                        words.push_back(word);
+                        if (!query_word.is_minus) {
+                            double& weight = result.word_weights.emplace(word, 0.0).first->second;
+                            weight = max(weight, pow(FUZZY_DISTANCE_PENALTY, distance));
+                        }
+                    });
+                } else {
+                    words.push_back(query_word.data);
+                    exact_plus_words.insert(query_word.data);
+                }
+            }
+            continue;
+        }
+
+        const bool closes_phrase = !word.empty() && word.back() == '"';
+        if (closes_phrase) {
+            word.remove_suffix(1);
+            in_phrase = false;
+        }
+        if (word.empty()) {
+            continue;
+        }
         const auto query_word = ParseQueryWord(word);
+        if (query_word.is_minus) {
+            throw invalid_argument("Minus words are not allowed in a phrase"s);
+        }
         if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                result.minus_words.push_back(query_word.data);
-            } else {
-                result.plus_words.push_back(query_word.data);
-            }
+            result.phrases.back().push_back(query_word.data);
+            result.plus_words.push_back(query_word.data);
+            exact_plus_words.insert(query_word.data);
         }
     }
+    if (in_phrase) {
+        throw invalid_argument("Phrase is not closed"s);
+    }
+
+    // a phrase of at most one word is an ordinary plus word
+    result.phrases.erase(
+            remove_if(result.phrases.begin(), result.phrases.end(), [](const pmr::vector<string_view>& phrase) {
+                return phrase.size() < 2;
+            }),
+            result.phrases.end());
+    if (!result.phrases.empty() && !store_positions_) {
+        throw invalid_argument("Phrase queries require stored word positions"s);
+    }
+    for (const string_view word : exact_plus_words) {
+        result.word_weights.erase(word);
+    }
+    for (auto it = result.word_weights.begin(); it != result.word_weights.end();) {
+        it = it->second == 1.0 ? result.word_weights.erase(it) : next(it);
+    }
 
     if(s) {
         sort(result.plus_words.begin(), result.plus_words.end());
@@ -159,12 +520,64 @@ SearchServer::Query SearchServer::ParseQuery(string_view text, const bool s) con
     return result;
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const string_view& word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+void SearchServer::ExpandPrefix(string_view prefix, pmr::vector<string_view>& words) const {
+    // the dictionary is sorted, so all words with the prefix form one contiguous range
+    int expansion_count = 0;
+    for (auto it = word_to_document_freqs_.lower_bound(prefix);
+         it != word_to_document_freqs_.end() && it->first.substr(0, prefix.size()) == prefix
+         && expansion_count < MAX_PREFIX_EXPANSION_COUNT;
+         ++it, ++expansion_count) {
+        words.push_back(it->first);
+    }
+}
+
+const DocumentBitmap& SearchServer::GetDocumentsWithStatus(DocumentStatus status) const {
+    return status_to_documents_.at(static_cast<size_t>(status));
+}
+
+bool SearchServer::IsSelectiveRatingRange(const DocumentFilter& filter) const {
+    const double max_candidate_count = MAX_RATING_CANDIDATE_SHARE * documents_.size();
+    int candidate_count = 0;
+    for (auto it = rating_to_document_count_.lower_bound(filter.min_rating);
+         it != rating_to_document_count_.end() && it->first <= filter.max_rating; ++it) {
+        candidate_count += it->second;
+        if (candidate_count > max_candidate_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+vector<int> SearchServer::SelectCandidates(const DocumentFilter& filter) const {
+    vector<int> candidate_ids;
+    const DocumentBitmap* documents_with_status = filter.status ? &GetDocumentsWithStatus(*filter.status) : nullptr;
+    for (auto it = rating_index_.lower_bound({filter.min_rating, numeric_limits<int>::min()});
+         it != rating_index_.end() && it->first <= filter.max_rating; ++it) {
+        const int document_id = it->second;
+        if (document_id >= filter.min_document_id && document_id <= filter.max_document_id
+            && (documents_with_status == nullptr || documents_with_status->Test(documents_.at(document_id).ordinal))) {
+            candidate_ids.push_back(document_id);
+        }
+    }
+    sort(candidate_ids.begin(), candidate_ids.end());
+    return candidate_ids;
+}
+
+void SearchServer::RemoveRating(int document_id) {
+    const int rating = documents_.at(document_id).rating;
+    rating_index_.erase({rating, document_id});
+    const auto count = rating_to_document_count_.find(rating);
+    if (--count->second == 0) {
+        rating_to_document_count_.erase(count);
+    }
+}
+
+double SearchServer::GetAverageDocumentLength() const {
+    return documents_.empty() ? 0.0 : static_cast<double>(total_document_length_) / documents_.size();
 }
 
-const map<string_view , double>& SearchServer::GetWordFrequencies(int document_id){
-    static const map<string_view, double> empty_map;
+const SearchServer::WordFrequencies& SearchServer::GetWordFrequencies(int document_id) const {
+    static const WordFrequencies empty_map;
     
     if (document_to_word_freqs_.count(document_id) == 0) {
         return empty_map;
@@ -173,18 +586,69 @@ const map<string_view , double>& SearchServer::GetWordFrequencies(int document_i
     return document_to_word_freqs_.at(document_id);
 }
 
+string_view SearchServer::InternWord(string_view word) {
+    auto it = words_.find(word);
+    if (it == words_.end()) {
+        it = words_.emplace(word).first;
+    }
+    return *it;
+}
+
+void SearchServer::RemoveWordPosting(string_view word, int document_id) {
+    const auto postings = word_to_document_freqs_.find(word);
+    if (postings->second.size() == max_posting_list_size_) {
+        max_posting_list_size_stale_ = true;
+    }
+    postings->second.erase(document_id);
+    --posting_count_;
+    if (postings->second.empty()) {
+        word_to_document_freqs_.erase(postings);
+        words_.erase(words_.find(word));
+    }
+}
+
+uint32_t SearchServer::AcquireOrdinal(int document_id, int document_length) {
+    if (free_ordinals_.empty()) {
+        ordinal_to_document_id_.push_back(document_id);
+        ordinal_to_document_length_.push_back(document_length);
+        return static_cast<uint32_t>(ordinal_to_document_id_.size() - 1);
+    }
+    const uint32_t ordinal = free_ordinals_.back();
+    free_ordinals_.pop_back();
+    ordinal_to_document_id_[ordinal] = document_id;
+    ordinal_to_document_length_[ordinal] = document_length;
+    return ordinal;
+}
+
+void SearchServer::ReleaseOrdinal(uint32_t ordinal) {
+    ordinal_to_document_id_[ordinal] = -1;
+    ordinal_to_document_length_[ordinal] = 0;
+    free_ordinals_.push_back(ordinal);
+}
+
 void SearchServer::RemoveDocument(int document_id){
+    RemoveFingerprint(document_id);
+    ReleaseOrdinal(documents_.at(document_id).ordinal);
+    total_document_length_ -= documents_.at(document_id).length;
+    status_to_documents_[static_cast<size_t>(documents_.at(document_id).status)].Reset(documents_.at(document_id).ordinal);
+    RemoveRating(document_id);
     documents_.erase(document_id);
     for (const auto& pair : document_to_word_freqs_.at(document_id)){
-        word_to_document_freqs_[pair.first].erase(document_id);
+        RemoveWordPosting(pair.first, document_id);
     }
     document_to_word_freqs_.erase(document_id);
+    document_to_word_positions_.erase(document_id);
     document_ids_.erase(find(document_ids_.begin(), document_ids_.end(), document_id));
 }
 void SearchServer::RemoveDocument(execution::sequenced_policy ex_policy, int document_id) {
     RemoveDocument(document_id);
 }
 void SearchServer::RemoveDocument(execution::parallel_policy ex_policy, int document_id) {
+    RemoveFingerprint(document_id);
+    ReleaseOrdinal(documents_.at(document_id).ordinal);
+    total_document_length_ -= documents_.at(document_id).length;
+    status_to_documents_[static_cast<size_t>(documents_.at(document_id).status)].Reset(documents_.at(document_id).ordinal);
+    RemoveRating(document_id);
     documents_.erase(document_id);
 
     const auto& word_freqs = document_to_word_freqs_.at(document_id);
@@ -204,6 +668,20 @@ void SearchServer::RemoveDocument(execution::parallel_policy ex_policy, int docu
                 word_to_document_freqs_.at(*ptr).erase(document_id);
             });
 
+    // the dictionary itself cannot be modified concurrently
+    posting_count_ -= words.size();
+    for (const string_view* ptr : words) {
+        const auto postings = word_to_document_freqs_.find(*ptr);
+        if (postings->second.size() + 1 == max_posting_list_size_) {
+            max_posting_list_size_stale_ = true;
+        }
+        if (postings->second.empty()) {
+            word_to_document_freqs_.erase(postings);
+            words_.erase(words_.find(*ptr));
+        }
+    }
+
     document_to_word_freqs_.erase(document_id);
+    document_to_word_positions_.erase(document_id);
     document_ids_.erase(find(document_ids_.begin(), document_ids_.end(), document_id));
 }
@@ -12,28 +12,150 @@
 #include <execution>
 #include <functional>
 #include <mutex>
+#include <unordered_map>
+#include <future>
+#include <memory>
+#include <array>
+#include <optional>
+#include <limits>
+#include <memory_resource>
 
 #include "document.h"
 #include "string_processing.h"
 #include "log_duration.h"
 #include "concurrent_map.h"
+#include "thread_pool.h"
+#include "document_fingerprint.h"
+#include "position_list.h"
+#include "scoring.h"
+#include "impact_quantization.h"
+#include "document_bitmap.h"
+#include "query_explanation.h"
+#include "metrics.h"
+#include "memory_usage.h"
+#include "query_arena.h"
+#include "score_accumulator.h"
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 const double RELEVANCE_COMPARISON_ERR = 1e-6;
+// a "prefix*" query word stands for at most this many dictionary words, lexicographically first
+const int MAX_PREFIX_EXPANSION_COUNT = 64;
+// "word~k" matches dictionary words within edit distance k, scored with FUZZY_DISTANCE_PENALTY^distance
+const int MAX_FUZZY_EDIT_DISTANCE = 2;
+const double FUZZY_DISTANCE_PENALTY = 0.5;
+// a rating range matching more than this share of the documents is checked per posting
+// rather than listed from the rating index
+const double MAX_RATING_CANDIDATE_SHARE = 0.1;
+
+// Declarative filter for FindTopDocuments. All bounds are inclusive. Rating bounds are
+// served by a sorted rating index, so a selective rating range skips most postings.
+struct DocumentFilter {
+    std::optional<DocumentStatus> status;
+    int min_rating = std::numeric_limits<int>::min();
+    int max_rating = std::numeric_limits<int>::max();
+    int min_document_id = 0;
+    int max_document_id = std::numeric_limits<int>::max();
+};
+
+// Position in a ranked result list just after the last document of a page. A
+// default-constructed cursor starts at the first result. Cursors are opaque and only
+// meaningful for the query, filter and scoring policy they were returned for.
+class SearchCursor {
+public:
+    SearchCursor() = default;
+
+private:
+    friend class SearchServer;
+
+    explicit SearchCursor(const Document& last_document)
+            : is_start_(false)
+            , relevance_(last_document.relevance)
+            , rating_(last_document.rating)
+            , document_id_(last_document.id) {
+    }
+
+    bool is_start_ = true;
+    double relevance_ = 0.0;
+    int rating_ = 0;
+    int document_id_ = 0;
+};
+
+struct ExplainedDocuments {
+    std::vector<Document> documents;
+    QueryExplanation explanation;
+};
+
+struct SearchPage {
+    std::vector<Document> documents;
+    // empty on the last page
+    std::optional<SearchCursor> next_cursor;
+};
+
+// What AddDocument does with a document whose set of words equals that of an indexed one.
+enum class DuplicateIngestMode {
+    ALLOW,
+    // throw invalid_argument
+    REJECT,
+    // report the duplicate and skip it without indexing
+    REPORT,
+};
 
 class SearchServer {
 public:
+    // Frequencies of the words of one document, in nodes from the server's memory resource.
+    // Converts to std::map so that code written when GetWordFrequencies returned
+    // const std::map<std::string_view, double>& still compiles; the conversion copies the
+    // map, so bind the result to const auto& instead.
+    class WordFrequencies : public std::pmr::map<std::string_view, double> {
+    public:
+        using std::pmr::map<std::string_view, double>::map;
+
+        operator std::map<std::string_view, double>() const {
+            return {begin(), end()};
+        }
+    };
 
+    // The nodes of the word and document maps come from resource, which must be thread-safe
+    // for the parallel RemoveDocument and outlive the server. By default the server owns a
+    // synchronized_pool_resource, so nodes are carved from pooled blocks instead of being
+    // separate heap allocations.
     template <typename StringContainer>
-    explicit SearchServer(const StringContainer& stop_words);
-    explicit SearchServer(const std::string& stop_words_text);
-    explicit SearchServer(const std::string_view stop_words_text);
+    explicit SearchServer(const StringContainer& stop_words, std::pmr::memory_resource* resource = nullptr);
+    explicit SearchServer(const std::string& stop_words_text, std::pmr::memory_resource* resource = nullptr);
+    explicit SearchServer(const std::string_view stop_words_text, std::pmr::memory_resource* resource = nullptr);
+
+    // Movable, not copyable: a copy would need its own memory resource and dictionary for
+    // the index maps to point into. Async searches and metric gauges hold the address of the
+    // server, so move it only before RegisterMetrics and with no async search pending.
+    SearchServer(SearchServer&& other) = default;
+    SearchServer(const SearchServer&) = delete;
+    SearchServer& operator=(const SearchServer&) = delete;
 
     void AddDocument(int document_id, const std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+    // Any mode other than ALLOW keeps a fingerprint index of the word sets of all documents.
+    void SetDuplicateIngestMode(DuplicateIngestMode mode);
+
+    // Word positions are needed for "quoted phrase" queries. Positions count words
+    // without stop words, so a phrase matches across removed stop words.
+    void SetStorePositions(bool store_positions);
+
+    // The overloads without a scoring policy rank by TfIdfScoring, see scoring.h.
+    template <typename ScoringPolicy, typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
+
+    template <typename ScoringPolicy, typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status) const;
+
+    template <typename ScoringPolicy, typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, const DocumentFilter& filter) const;
+
     template <typename ExecutionPolicy, typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
 
+    template<typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, const DocumentFilter& filter) const;
+
     template<typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status) const;
 
@@ -47,11 +169,75 @@ public:
         return FindTopDocuments(std::execution::seq, raw_query, status);
     }
 
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, const DocumentFilter& filter) const{
+        return FindTopDocuments(std::execution::seq, raw_query, filter);
+    }
+
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const{
         return FindTopDocuments(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
     }
 
+    // FindTopDocuments that also reports phase timings, work counters and how every returned
+    // document was scored. selector is a predicate, a DocumentStatus or a DocumentFilter.
+    template <typename ScoringPolicy, typename ExecutionPolicy, typename DocumentSelector>
+    ExplainedDocuments ExplainTopDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, DocumentSelector selector) const;
+
+    template <typename ExecutionPolicy, typename DocumentSelector>
+    ExplainedDocuments ExplainTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, DocumentSelector selector) const {
+        return ExplainTopDocuments(TfIdfScoring{}, policy, raw_query, selector);
+    }
+
+    ExplainedDocuments ExplainTopDocuments(std::string_view raw_query) const {
+        return ExplainTopDocuments(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
+    }
+
+    // Search-after pagination: up to page_size documents ranked after cursor, and the cursor
+    // of the next page. Pages are ordered by relevance, rating and then id, compared exactly
+    // so that the order is total; the first page may differ from FindTopDocuments for
+    // documents whose relevance differs by less than RELEVANCE_COMPARISON_ERR. Scoring is
+    // sequential, as parallel summation could change relevance between calls.
+    template <typename ScoringPolicy>
+    SearchPage FindTopDocumentsAfter(const ScoringPolicy& scoring, std::string_view raw_query, const DocumentFilter& filter,
+                                     const SearchCursor& cursor, size_t page_size) const;
+
+    SearchPage FindTopDocumentsAfter(std::string_view raw_query, const DocumentFilter& filter,
+                                     const SearchCursor& cursor, size_t page_size) const {
+        return FindTopDocumentsAfter(TfIdfScoring{}, raw_query, filter, cursor, page_size);
+    }
+
+    SearchPage FindTopDocumentsAfter(std::string_view raw_query, const SearchCursor& cursor, size_t page_size) const {
+        DocumentFilter filter;
+        filter.status = DocumentStatus::ACTUAL;
+        return FindTopDocumentsAfter(raw_query, filter, cursor, page_size);
+    }
+
+    // Async searches run sequentially on a pool owned by the server, so the number of
+    // worker threads is the only knob for search concurrency. Zero means one per core.
+    // Like AddDocument, must not race with other calls.
+    void SetAsyncThreadCount(size_t thread_count);
+
+    template <typename DocumentPredicate>
+    std::future<std::vector<Document>> FindTopDocumentsAsync(std::string raw_query, DocumentPredicate document_predicate) const;
+
+    std::future<std::vector<Document>> FindTopDocumentsAsync(std::string raw_query) const {
+        return FindTopDocumentsAsync(std::move(raw_query), DocumentStatus::ACTUAL);
+    }
+
+    // callback is invoked on a pool thread as callback(documents, error)
+    template <typename DocumentPredicate, typename Callback>
+    void FindTopDocumentsAsync(std::string raw_query, DocumentPredicate document_predicate, Callback callback) const;
+
     int GetDocumentCount() const;
+
+    // Estimated heap bytes of the index by component, including allocator overhead.
+    // Walks every structure, so it costs about as much as copying the index keys.
+    IndexMemoryUsage MemoryUsage() const;
+
+    // Counts searches and their latency in registry and exports index sizes and memory. The registry
+    // must outlive the server. The gauges read the index without locking, so dump the registry from
+    // the thread that adds and removes documents, or while no other thread does; searches may run
+    // meanwhile. The gauges reading the index are removed when the server is destroyed.
+    void RegisterMetrics(MetricsRegistry& registry);
     
     std::vector<int>::const_iterator begin() const;
     std::vector<int>::const_iterator end() const;
@@ -60,7 +246,15 @@ public:
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::sequenced_policy policy, std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::parallel_policy policy, std::string_view raw_query, int document_id) const;
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id);
+    // Matches one query against many documents, e.g. the results of FindTopDocuments. The query
+    // is parsed once and merged with the sorted words of every document.
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(
+            std::string_view raw_query, const std::vector<int>& document_ids) const;
+    template <typename ExecutionPolicy>
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(
+            ExecutionPolicy& policy, std::string_view raw_query, const std::vector<int>& document_ids) const;
+
+    const WordFrequencies& GetWordFrequencies(int document_id) const;
     void RemoveDocument(int document_id);
     void RemoveDocument(std::execution::sequenced_policy ex_policy, int document_id);
     void RemoveDocument(std::execution::parallel_policy ex_policy, int document_id);
@@ -71,6 +265,18 @@ private:
         int rating;
         DocumentStatus status;
         std::string content;
+        // number of non-stop words
+        int length;
+        TermSetFingerprint fingerprint;
+        // dense index of the document, reused after removal
+        uint32_t ordinal;
+    };
+
+    struct Posting {
+        // exact or quantized, see impact_quantization.h
+        TermFreqCodec::Code term_freq;
+        // of the document, so that the score accumulator needs no id lookup
+        uint32_t ordinal;
     };
     
     struct QueryWord {
@@ -79,16 +285,92 @@ private:
         bool is_stop;
     };
     
+    // Searches build the query in the QueryArena of their thread.
     struct Query {
-        std::vector<std::string_view> plus_words;
-        std::vector<std::string_view> minus_words;
+        explicit Query(std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+                : plus_words(resource)
+                , minus_words(resource)
+                , phrases(resource)
+                , word_weights(resource) {
+        }
+
+        std::pmr::vector<std::string_view> plus_words;
+        std::pmr::vector<std::string_view> minus_words;
+        // words of every phrase are plus words as well, so phrases only filter the candidates
+        std::pmr::vector<std::pmr::vector<std::string_view>> phrases;
+        // plus words found only by fuzzy matching; every other plus word has weight 1
+        std::pmr::map<std::string_view, double> word_weights;
+
+        double GetWordWeight(std::string_view word) const {
+            const auto it = word_weights.find(word);
+            return it == word_weights.end() ? 1.0 : it->second;
+        }
     };
     
+    // declared before the maps that allocate from it
+    std::unique_ptr<std::pmr::memory_resource> owned_resource_;
+    std::pmr::memory_resource* const resource_;
+
     const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
+    // owns the text of every indexed word; the index maps key on views of these strings,
+    // which stay valid after the documents that introduced them are removed
+    std::set<std::string, std::less<>> words_;
+    std::pmr::map<std::string_view, std::pmr::map<int, Posting>> word_to_document_freqs_;
+    std::pmr::map<int, WordFrequencies> document_to_word_freqs_;
     std::map<int, DocumentData> documents_;
     std::vector<int> document_ids_;
+    // document id by ordinal, -1 for a free ordinal
+    std::vector<int> ordinal_to_document_id_;
+    std::vector<uint32_t> free_ordinals_;
+    // document length by ordinal, so that length-aware scoring needs no document lookup per posting
+    std::vector<int> ordinal_to_document_length_;
+    int64_t total_document_length_ = 0;
+    // for the metric gauges, so that a dump does not walk every posting list
+    size_t posting_count_ = 0;
+    size_t max_posting_list_size_ = 0;
+    // set when a removal may have shrunk the longest posting list; the next dump recounts it
+    bool max_posting_list_size_stale_ = false;
+    // ordinals of the documents with each DocumentStatus, for the status overloads of FindTopDocuments
+    std::array<DocumentBitmap, 4> status_to_documents_;
+    // (rating, document id) pairs of all documents
+    std::set<std::pair<int, int>> rating_index_;
+    // number of documents by rating, to estimate how selective a rating range is
+    std::map<int, int> rating_to_document_count_;
+
+    bool store_positions_ = false;
+    std::map<int, std::map<std::string_view, PositionList>> document_to_word_positions_;
+
+    DuplicateIngestMode duplicate_ingest_mode_ = DuplicateIngestMode::ALLOW;
+    std::unordered_map<TermSetFingerprint, std::vector<int>, TermSetFingerprintHasher> fingerprint_to_documents_;
+
+    Counter* query_counter_ = nullptr;
+    Histogram* query_latency_ = nullptr;
+    // after the index, so that its gauges are removed first
+    MetricsRegistration metrics_registration_;
+
+    // held by pointer so that the mutex does not pin the server in place
+    struct AsyncState {
+        std::mutex mutex;
+        size_t thread_count = 0;
+        std::unique_ptr<ThreadPool> thread_pool;
+    };
+    // declared last so that pending async searches finish before the index is destroyed
+    std::unique_ptr<AsyncState> async_state_ = std::make_unique<AsyncState>();
+
+    ThreadPool& GetThreadPool() const;
+
+    // the clock is only read when metrics are registered
+    std::chrono::steady_clock::time_point GetQueryStartTime() const;
+    void RecordQueryMetrics(std::chrono::steady_clock::time_point start_time) const;
+
+    std::string_view InternWord(std::string_view word);
+    // id of an indexed document with exactly these words, or -1
+    int FindDocumentWithWords(const TermSetFingerprint& fingerprint, const std::vector<std::string_view>& sorted_words) const;
+    void RemoveFingerprint(int document_id);
+    void RemoveWordPosting(std::string_view word, int document_id);
+    void RemoveRating(int document_id);
+    uint32_t AcquireOrdinal(int document_id, int document_length);
+    void ReleaseOrdinal(uint32_t ordinal);
 
     bool IsStopWord(std::string_view word) const;
     
@@ -98,16 +380,73 @@ private:
 
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
-    QueryWord ParseQueryWord(std::string_view text) const;
-    Query ParseQuery(std::string_view text, const bool s) const;
+    // query words must be sorted and unique
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchParsedQuery(const Query& query, int document_id) const;
 
-    double ComputeWordInverseDocumentFreq(const std::string_view& word) const;
+    void AddWordPositions(int document_id, const std::vector<std::string_view>& words);
+    bool ContainsPhrase(int document_id, const std::pmr::vector<std::string_view>& phrase) const;
 
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(std::execution::parallel_policy policy, const Query& query, DocumentPredicate document_predicate) const;
-
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(std::execution::sequenced_policy policy, const Query& query, DocumentPredicate document_predicate) const;
+    QueryWord ParseQueryWord(std::string_view text) const;
+    // position of the fuzzy '~' in "word~" or "word~N", npos for a literal word
+    static size_t FindFuzzyMark(std::string_view word);
+    void ExpandPrefix(std::string_view prefix, std::pmr::vector<std::string_view>& words) const;
+    // calls callback(word, distance) for every dictionary word within max_distance edits of pattern
+    template <typename Callback>
+    void ExpandFuzzy(std::string_view pattern, int max_distance, Callback callback) const;
+    Query ParseQuery(std::string_view text, const bool s,
+                     std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const;
+
+    template <typename ScoringPolicy>
+    double ComputeWordInverseDocumentFreq(const ScoringPolicy& scoring, const std::string_view& word) const;
+    double GetAverageDocumentLength() const;
+
+    const DocumentBitmap& GetDocumentsWithStatus(DocumentStatus status) const;
+
+    // candidate_filter(document_id, ordinal) decides whether a posting counts; filters are built
+    // from a DocumentPredicate or directly from bitmaps, which are keyed by ordinal. When candidate_ids lists every document the
+    // filter accepts, short lists are probed in the posting lists instead of scanning them.
+    // The tracer sees every phase of the search, see query_explanation.h.
+    template <typename ScoringPolicy, typename ExecutionPolicy, typename CandidateFilter, typename Tracer = NullQueryTracer>
+    std::vector<Document> FindTopFilteredDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, CandidateFilter candidate_filter,
+                                                   const std::vector<int>* candidate_ids = nullptr, Tracer&& tracer = Tracer{}) const;
+
+    template <typename ScoringPolicy, typename ExecutionPolicy, typename DocumentPredicate, typename Tracer>
+    std::vector<Document> FindTopTracedDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate,
+                                                 Tracer& tracer) const;
+
+    template <typename ScoringPolicy, typename ExecutionPolicy, typename Tracer>
+    std::vector<Document> FindTopTracedDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status,
+                                                 Tracer& tracer) const;
+
+    template <typename ScoringPolicy, typename ExecutionPolicy, typename Tracer>
+    std::vector<Document> FindTopTracedDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, const DocumentFilter& filter,
+                                                 Tracer& tracer) const;
+
+    // All matching documents, unsorted. The query and every temporary, including the
+    // returned vector, are allocated from resource.
+    template <typename ScoringPolicy, typename ExecutionPolicy, typename CandidateFilter, typename Tracer = NullQueryTracer>
+    std::pmr::vector<Document> FindMatchedDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, CandidateFilter candidate_filter,
+                                                    const std::vector<int>* candidate_ids, std::pmr::memory_resource* resource,
+                                                    Tracer&& tracer = Tracer{}) const;
+
+    // calls search(candidate_filter, candidate_ids) with the cheapest filter for a DocumentFilter
+    template <typename Search>
+    auto SearchWithFilter(const DocumentFilter& filter, Search search) const;
+
+    template <typename ScoringPolicy, typename CandidateFilter, typename Tracer>
+    std::pmr::vector<Document> FindAllDocuments(const ScoringPolicy& scoring, std::execution::parallel_policy policy, const Query& query, CandidateFilter candidate_filter,
+                                                const std::vector<int>* candidate_ids, Tracer& tracer) const;
+
+    template <typename ScoringPolicy, typename CandidateFilter, typename Tracer>
+    std::pmr::vector<Document> FindAllDocuments(const ScoringPolicy& scoring, std::execution::sequenced_policy policy, const Query& query, CandidateFilter candidate_filter,
+                                                const std::vector<int>* candidate_ids, Tracer& tracer) const;
+
+    bool IsSelectiveRatingRange(const DocumentFilter& filter) const;
+    // sorted ids of the documents passing filter, listed from the rating index
+    std::vector<int> SelectCandidates(const DocumentFilter& filter) const;
+
+    template <typename ScoringPolicy>
+    int GetScoredDocumentLength(uint32_t ordinal) const;
 };
 
 std::ostream& operator<<(std::ostream& out, const Document& document);
@@ -117,7 +456,12 @@ void PrintDocument(const Document& document);
 void PrintMatchDocumentResult(int document_id, const std::vector<std::string>& words, DocumentStatus status);
 
 template <typename StringContainer>
-SearchServer::SearchServer(const StringContainer &stop_words): stop_words_(MakeUniqueNonEmptyStrings(stop_words)){
+SearchServer::SearchServer(const StringContainer &stop_words, std::pmr::memory_resource* resource)
+        : owned_resource_(resource == nullptr ? std::make_unique<std::pmr::synchronized_pool_resource>() : nullptr)
+        , resource_(resource == nullptr ? owned_resource_.get() : resource)
+        , stop_words_(MakeUniqueNonEmptyStrings(stop_words))
+        , word_to_document_freqs_(resource_)
+        , document_to_word_freqs_(resource_) {
     using namespace std::string_literals;
     if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
         throw std::invalid_argument("Some of stop words are invalid"s);
@@ -129,11 +473,161 @@ void AddDocument(SearchServer& search_server, int document_id,
                  DocumentStatus status,
                  const std::vector<int>& ratings);
 
-template <typename ExecutionPolicy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
-    const Query query = ParseQuery(raw_query, true);
+template <typename ScoringPolicy, typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
+    NullQueryTracer tracer;
+    return FindTopTracedDocuments(scoring, policy, raw_query, document_predicate, tracer);
+}
+
+template <typename ScoringPolicy, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status) const {
+    NullQueryTracer tracer;
+    return FindTopTracedDocuments(scoring, policy, raw_query, status, tracer);
+}
+
+template <typename ScoringPolicy, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, const DocumentFilter& filter) const {
+    NullQueryTracer tracer;
+    return FindTopTracedDocuments(scoring, policy, raw_query, filter, tracer);
+}
+
+template <typename ScoringPolicy, typename ExecutionPolicy, typename DocumentSelector>
+ExplainedDocuments SearchServer::ExplainTopDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, DocumentSelector selector) const {
+    QueryExplainTracer tracer;
+    ExplainedDocuments result;
+    result.documents = FindTopTracedDocuments(scoring, policy, raw_query, selector, tracer);
+    result.explanation = tracer.TakeExplanation();
+
+    const double average_document_length = GetAverageDocumentLength();
+    for (const Document& document : result.documents) {
+        const auto& word_freqs = document_to_word_freqs_.at(document.id);
+        const int document_length = GetScoredDocumentLength<ScoringPolicy>(documents_.at(document.id).ordinal);
+        DocumentExplanation& document_explanation = result.explanation.documents.emplace_back();
+        document_explanation.document_id = document.id;
+        for (const TermExplanation& term : result.explanation.terms) {
+            const auto it = word_freqs.find(term.word);
+            // the term frequency as the postings store it, so that contributions add up to the relevance
+            document_explanation.term_contributions.push_back(
+                    it == word_freqs.end() ? 0.0 : scoring.TermScore(TermFreqCodec::Decode(TermFreqCodec::Encode(it->second)),
+                                                                      term.inverse_document_freq,
+                                                                      document_length,
+                                                                      average_document_length));
+        }
+    }
+    return result;
+}
+
+template <typename ScoringPolicy, typename ExecutionPolicy, typename DocumentPredicate, typename Tracer>
+std::vector<Document> SearchServer::FindTopTracedDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate,
+                                                           Tracer& tracer) const {
+    return FindTopFilteredDocuments(scoring, policy, raw_query, [this, &document_predicate, &tracer](int document_id, uint32_t /*ordinal*/) {
+        tracer.OnPredicateCall();
+        const auto &document_data = documents_.at(document_id);
+        return document_predicate(document_id, document_data.status, document_data.rating);
+    }, nullptr, tracer);
+}
+
+template <typename ScoringPolicy, typename ExecutionPolicy, typename Tracer>
+std::vector<Document> SearchServer::FindTopTracedDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status,
+                                                           Tracer& tracer) const {
+    const DocumentBitmap& documents_with_status = GetDocumentsWithStatus(status);
+    return FindTopFilteredDocuments(scoring, policy, raw_query, [&documents_with_status](int /*document_id*/, uint32_t ordinal) {
+        return documents_with_status.Test(ordinal);
+    }, nullptr, tracer);
+}
+
+template <typename ScoringPolicy, typename ExecutionPolicy, typename Tracer>
+std::vector<Document> SearchServer::FindTopTracedDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, const DocumentFilter& filter,
+                                                           Tracer& tracer) const {
+    return SearchWithFilter(filter, [&](auto candidate_filter, const std::vector<int>* candidate_ids) {
+        return FindTopFilteredDocuments(scoring, policy, raw_query, candidate_filter, candidate_ids, tracer);
+    });
+}
 
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+template <typename Search>
+auto SearchServer::SearchWithFilter(const DocumentFilter& filter, Search search) const {
+    const bool has_rating_bounds = filter.min_rating != std::numeric_limits<int>::min()
+                                   || filter.max_rating != std::numeric_limits<int>::max();
+    if (!has_rating_bounds || !IsSelectiveRatingRange(filter)) {
+        const DocumentBitmap* documents_with_status = filter.status ? &GetDocumentsWithStatus(*filter.status) : nullptr;
+        return search([this, &filter, documents_with_status, has_rating_bounds](int document_id, uint32_t ordinal) {
+            if (document_id < filter.min_document_id || document_id > filter.max_document_id
+                || (documents_with_status != nullptr && !documents_with_status->Test(ordinal))) {
+                return false;
+            }
+            if (!has_rating_bounds) {
+                return true;
+            }
+            const int rating = documents_.at(document_id).rating;
+            return rating >= filter.min_rating && rating <= filter.max_rating;
+        }, nullptr);
+    }
+
+    const std::vector<int> candidate_ids = SelectCandidates(filter);
+    return search([&candidate_ids](int document_id, uint32_t /*ordinal*/) {
+        return std::binary_search(candidate_ids.begin(), candidate_ids.end(), document_id);
+    }, &candidate_ids);
+}
+
+template <typename ScoringPolicy>
+SearchPage SearchServer::FindTopDocumentsAfter(const ScoringPolicy& scoring, std::string_view raw_query, const DocumentFilter& filter,
+                                               const SearchCursor& cursor, size_t page_size) const {
+    using namespace std::string_literals;
+    if (page_size == 0) {
+        throw std::invalid_argument("Page size must be positive"s);
+    }
+    PROFILE_SCOPE("FindTopDocumentsAfter");
+    const auto start_time = GetQueryStartTime();
+
+    const auto ranks_before = [](const Document& lhs, const Document& rhs) {
+        return std::tuple(-lhs.relevance, -lhs.rating, lhs.id) < std::tuple(-rhs.relevance, -rhs.rating, rhs.id);
+    };
+    const Document last_document(cursor.document_id_, cursor.relevance_, cursor.rating_);
+
+    const QueryArena::Scope arena;
+    const std::pmr::vector<Document> matched_documents = SearchWithFilter(filter, [&](auto candidate_filter, const std::vector<int>* candidate_ids) {
+        return FindMatchedDocuments(scoring, std::execution::seq, raw_query, candidate_filter, candidate_ids, arena.GetResource());
+    });
+
+    PROFILE_SCOPE("SelectPage");
+    // a max-heap of the page_size + 1 best documents after the cursor, the worst on top;
+    // the extra document tells whether there is a next page
+    std::vector<Document> page;
+    page.reserve(std::min(page_size + 1, matched_documents.size()));
+    for (const Document& document : matched_documents) {
+        if (!cursor.is_start_ && !ranks_before(last_document, document)) {
+            continue;
+        }
+        if (page.size() <= page_size) {
+            page.push_back(document);
+            std::push_heap(page.begin(), page.end(), ranks_before);
+        } else if (ranks_before(document, page.front())) {
+            std::pop_heap(page.begin(), page.end(), ranks_before);
+            page.back() = document;
+            std::push_heap(page.begin(), page.end(), ranks_before);
+        }
+    }
+    std::sort_heap(page.begin(), page.end(), ranks_before);
+
+    SearchPage result;
+    if (page.size() > page_size) {
+        page.pop_back();
+        result.next_cursor = SearchCursor(page.back());
+    }
+    result.documents = std::move(page);
+    RecordQueryMetrics(start_time);
+    return result;
+}
+
+template <typename ScoringPolicy, typename ExecutionPolicy, typename CandidateFilter, typename Tracer>
+std::vector<Document> SearchServer::FindTopFilteredDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, CandidateFilter candidate_filter,
+                                                             const std::vector<int>* candidate_ids, Tracer&& tracer) const {
+    PROFILE_SCOPE("FindTopDocuments");
+    const auto start_time = GetQueryStartTime();
+    const QueryArena::Scope arena;
+    auto matched_documents = FindMatchedDocuments(scoring, policy, raw_query, candidate_filter, candidate_ids, arena.GetResource(), tracer);
+    PROFILE_SCOPE("SortResults");
+    const auto ranking_timer = tracer.StartTimer(QueryPhase::RANKING);
     sort(matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
         if (std::abs(lhs.relevance - rhs.relevance) < RELEVANCE_COMPARISON_ERR) {
             return lhs.rating > rhs.rating;
@@ -141,18 +635,27 @@ std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy& policy, st
             return lhs.relevance > rhs.relevance;
         }
     });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
+    // the results leave the arena
+    std::vector<Document> top_documents(matched_documents.begin(),
+                                        matched_documents.begin() + std::min<size_t>(matched_documents.size(), MAX_RESULT_DOCUMENT_COUNT));
 
-    return matched_documents;
+    RecordQueryMetrics(start_time);
+    return top_documents;
+}
+
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
+    return FindTopDocuments(TfIdfScoring{}, policy, raw_query, document_predicate);
 }
 
 template<typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(policy, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status;
-    });
+    return FindTopDocuments(TfIdfScoring{}, policy, raw_query, status);
+}
+
+template<typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy& policy, std::string_view raw_query, const DocumentFilter& filter) const {
+    return FindTopDocuments(TfIdfScoring{}, policy, raw_query, filter);
 }
 
 template<typename ExecutionPolicy>
@@ -166,37 +669,173 @@ std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::parallel_policy policy, const Query& query, DocumentPredicate document_predicate) const {
+std::future<std::vector<Document>> SearchServer::FindTopDocumentsAsync(std::string raw_query, DocumentPredicate document_predicate) const {
+    return GetThreadPool().Submit([this, raw_query = std::move(raw_query), document_predicate]() {
+        return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+    });
+}
+
+template <typename DocumentPredicate, typename Callback>
+void SearchServer::FindTopDocumentsAsync(std::string raw_query, DocumentPredicate document_predicate, Callback callback) const {
+    GetThreadPool().Submit([this, raw_query = std::move(raw_query), document_predicate, callback = std::move(callback)]() mutable {
+        std::vector<Document> documents;
+        std::exception_ptr error;
+        try {
+            documents = FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        callback(std::move(documents), error);
+    });
+}
+
+template <typename ExecutionPolicy>
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(
+        ExecutionPolicy& policy, std::string_view raw_query, const std::vector<int>& document_ids) const {
+    const Query query = ParseQuery(raw_query, true);
+
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> matches(document_ids.size());
+    std::transform(policy, document_ids.begin(), document_ids.end(), matches.begin(),
+                   [this, &query](int document_id) {
+                       return MatchParsedQuery(query, document_id);
+                   });
+    return matches;
+}
+
+template <typename Callback>
+void SearchServer::ExpandFuzzy(std::string_view pattern, int max_distance, Callback callback) const {
+    // A Levenshtein automaton run over the sorted dictionary: rows[i] is the edit distance row
+    // after the first i letters of the current word, and rows are shared with the previous
+    // word for their common prefix. Once a row exceeds max_distance everywhere, no word with
+    // that prefix can match, and the whole range of such words is skipped.
+    std::vector<std::vector<int>> rows(1, std::vector<int>(pattern.size() + 1));
+    std::iota(rows[0].begin(), rows[0].end(), 0);
+
+    std::string_view previous_word;
+    auto it = word_to_document_freqs_.begin();
+    while (it != word_to_document_freqs_.end()) {
+        const std::string_view word = it->first;
+        const size_t common_size = std::mismatch(word.begin(), word.end(), previous_word.begin(), previous_word.end()).first - word.begin();
+        rows.resize(std::min(rows.size(), common_size + 1));
+        previous_word = word;
+
+        size_t dead_prefix_size = 0;
+        for (size_t i = rows.size() - 1; i < word.size(); ++i) {
+            const std::vector<int>& row = rows.back();
+            std::vector<int> next_row(pattern.size() + 1);
+            next_row[0] = row[0] + 1;
+            for (size_t j = 1; j <= pattern.size(); ++j) {
+                next_row[j] = std::min({row[j] + 1, next_row[j - 1] + 1, row[j - 1] + (pattern[j - 1] != word[i])});
+            }
+            const bool is_dead = *std::min_element(next_row.begin(), next_row.end()) > max_distance;
+            rows.push_back(std::move(next_row));
+            if (is_dead) {
+                dead_prefix_size = i + 1;
+                break;
+            }
+        }
+
+        if (dead_prefix_size == 0) {
+            if (rows.back()[pattern.size()] <= max_distance) {
+                callback(word, rows.back()[pattern.size()]);
+            }
+            ++it;
+            continue;
+        }
+
+        std::string next_prefix(word.substr(0, dead_prefix_size));
+        while (!next_prefix.empty() && static_cast<unsigned char>(next_prefix.back()) == 0xFF) {
+            next_prefix.pop_back();
+        }
+        if (next_prefix.empty()) {
+            break;
+        }
+        ++next_prefix.back();
+        it = word_to_document_freqs_.lower_bound(next_prefix);
+    }
+}
+
+template <typename ScoringPolicy>
+double SearchServer::ComputeWordInverseDocumentFreq(const ScoringPolicy& scoring, const std::string_view& word) const {
+    return scoring.InverseDocumentFreq(GetDocumentCount(), word_to_document_freqs_.at(word).size());
+}
 
-    bool isMinusWordInDoc = any_of(policy,
-                                   query.minus_words.begin(),
-                                   query.minus_words.end(),
-                                   [this](const std::string_view &word) {
-                                       return word_to_document_freqs_.count(word);
-                                   });
+template <typename ScoringPolicy>
+int SearchServer::GetScoredDocumentLength(uint32_t ordinal) const {
+    if constexpr (ScoringPolicy::uses_document_length) {
+        return ordinal_to_document_length_[ordinal];
+    } else {
+        return 0;
+    }
+}
+
+template <typename ScoringPolicy, typename ExecutionPolicy, typename CandidateFilter, typename Tracer>
+std::pmr::vector<Document> SearchServer::FindMatchedDocuments(const ScoringPolicy& scoring, ExecutionPolicy& policy, std::string_view raw_query, CandidateFilter candidate_filter,
+                                                              const std::vector<int>* candidate_ids, std::pmr::memory_resource* resource,
+                                                              Tracer&& tracer) const {
+    // built in place, as assigning would copy the query out of resource
+    const Query query = [&] {
+        const auto parse_timer = tracer.StartTimer(QueryPhase::PARSE);
+        return ParseQuery(raw_query, true, resource);
+    }();
+
+    auto matched_documents = FindAllDocuments(scoring, policy, query, candidate_filter, candidate_ids, tracer);
+    const auto filtering_timer = tracer.StartTimer(QueryPhase::FILTERING);
+    for (const auto& phrase : query.phrases) {
+        const auto phrase_end = std::remove_if(matched_documents.begin(), matched_documents.end(), [this, &phrase](const Document& document) {
+            return !ContainsPhrase(document.id, phrase);
+        });
+        tracer.OnPruned(matched_documents.end() - phrase_end);
+        matched_documents.erase(phrase_end, matched_documents.end());
+    }
+    return matched_documents;
+}
 
+template <typename ScoringPolicy, typename CandidateFilter, typename Tracer>
+std::pmr::vector<Document> SearchServer::FindAllDocuments(const ScoringPolicy& scoring, std::execution::parallel_policy policy, const Query& query, CandidateFilter candidate_filter,
+                                                          const std::vector<int>* /*candidate_ids*/, Tracer& tracer) const {
+    PROFILE_SCOPE("TraversePostings");
+    const double average_document_length = GetAverageDocumentLength();
     ConcurrentMap<int, double> document_to_relevance(100);
-    if (!isMinusWordInDoc) {
-        std::for_each(std::execution::par,
+    {
+        const auto traversal_timer = tracer.StartTimer(QueryPhase::TRAVERSAL);
+        std::for_each(policy,
                       query.plus_words.begin(), query.plus_words.end(),
-                      [this, &document_to_relevance, &document_predicate](const std::string_view word) {
-                          if (!word_to_document_freqs_.count(word) == 0) {
-                              const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                              for (const auto[document_id, term_freq]: word_to_document_freqs_.at(word)) {
-                                  const auto &document_data = documents_.at(document_id);
-                                  if (document_predicate(document_id, document_data.status,
-                                                         document_data.rating)) {
-                                      document_to_relevance[document_id].ref_to_value +=
-                                              term_freq * inverse_document_freq;
-                                  }
+                      [&, this](const std::string_view word) {
+                          if (word_to_document_freqs_.count(word) == 0) {
+                              return;
+                          }
+                          const double inverse_document_freq = ComputeWordInverseDocumentFreq(scoring, word) * query.GetWordWeight(word);
+                          const auto& postings = word_to_document_freqs_.at(word);
+                          tracer.OnTerm(word, postings.size(), inverse_document_freq);
+                          tracer.OnPostings(postings.size());
+                          for (const auto& [document_id, posting]: postings) {
+                              if (candidate_filter(document_id, posting.ordinal)) {
+                                  document_to_relevance[document_id].ref_to_value +=
+                                          scoring.TermScore(TermFreqCodec::Decode(posting.term_freq), inverse_document_freq,
+                                                            GetScoredDocumentLength<ScoringPolicy>(posting.ordinal),
+                                                            average_document_length);
                               }
                           }
                       });
     }
 
     auto result = document_to_relevance.BuildOrdinaryMap();
+    tracer.OnCandidates(result.size());
+
+    {
+        const auto filtering_timer = tracer.StartTimer(QueryPhase::FILTERING);
+        for (const std::string_view &word: query.minus_words) {
+            if (word_to_document_freqs_.count(word) == 0) {
+                continue;
+            }
+            for (const auto& [document_id, _]: word_to_document_freqs_.at(word)) {
+                tracer.OnPruned(result.erase(document_id));
+            }
+        }
+    }
 
-    std::vector<Document> matched_documents(result.size());
+    std::pmr::vector<Document> matched_documents(result.size(), query.plus_words.get_allocator());
     std::atomic_int index = 0;
     std::for_each(
             std::execution::par,
@@ -207,35 +846,65 @@ std::vector<Document> SearchServer::FindAllDocuments(std::execution::parallel_po
     return matched_documents;
 }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::sequenced_policy ex_policy, const Query& query, DocumentPredicate document_predicate) const {
-
-    std::map<int, double> document_to_relevance;
-    for (const std::string_view &word: query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto[document_id, term_freq]: word_to_document_freqs_.at(word)) {
-            const auto &document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+template <typename ScoringPolicy, typename CandidateFilter, typename Tracer>
+std::pmr::vector<Document> SearchServer::FindAllDocuments(const ScoringPolicy& scoring, std::execution::sequenced_policy ex_policy, const Query& query, CandidateFilter candidate_filter,
+                                                          const std::vector<int>* candidate_ids, Tracer& tracer) const {
+    PROFILE_SCOPE("TraversePostings");
+    const double average_document_length = GetAverageDocumentLength();
+    const ScoreAccumulator::Lease document_to_relevance(ordinal_to_document_id_.size());
+    {
+        const auto traversal_timer = tracer.StartTimer(QueryPhase::TRAVERSAL);
+        for (const std::string_view &word: query.plus_words) {
+            if (word_to_document_freqs_.count(word) == 0) {
+                continue;
+            }
+            const double inverse_document_freq = ComputeWordInverseDocumentFreq(scoring, word) * query.GetWordWeight(word);
+            const auto& postings = word_to_document_freqs_.at(word);
+            tracer.OnTerm(word, postings.size(), inverse_document_freq);
+            const auto add_posting = [&](const Posting& posting) {
+                document_to_relevance->Add(posting.ordinal, scoring.TermScore(TermFreqCodec::Decode(posting.term_freq), inverse_document_freq,
+                                                                              GetScoredDocumentLength<ScoringPolicy>(posting.ordinal),
+                                                                              average_document_length));
+            };
+
+            if (candidate_ids != nullptr && candidate_ids->size() * std::log2(postings.size() + 1.0) < postings.size()) {
+                tracer.OnPostings(candidate_ids->size());
+                for (const int document_id : *candidate_ids) {
+                    const auto posting = postings.find(document_id);
+                    if (posting != postings.end()) {
+                        add_posting(posting->second);
+                    }
+                }
+                continue;
+            }
+            tracer.OnPostings(postings.size());
+            for (const auto& [document_id, posting]: postings) {
+                if (candidate_filter(document_id, posting.ordinal)) {
+                    add_posting(posting);
+                }
             }
         }
     }
+    tracer.OnCandidates(document_to_relevance->GetTouchedCount());
 
-    for (const std::string_view &word: query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        for (const auto[document_id, _]: word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
+    {
+        const auto filtering_timer = tracer.StartTimer(QueryPhase::FILTERING);
+        for (const std::string_view &word: query.minus_words) {
+            if (word_to_document_freqs_.count(word) == 0) {
+                continue;
+            }
+            for (const auto& [_, posting]: word_to_document_freqs_.at(word)) {
+                tracer.OnPruned(document_to_relevance->Remove(posting.ordinal));
+            }
         }
     }
 
-    std::vector<Document> matched_documents;
-    for (const auto[document_id, relevance]: document_to_relevance) {
+    // the results share the allocator of the query
+    std::pmr::vector<Document> matched_documents(query.plus_words.get_allocator());
+    matched_documents.reserve(document_to_relevance->GetTouchedCount());
+    document_to_relevance->ForEachScore([&](uint32_t ordinal, double relevance) {
+        const int document_id = ordinal_to_document_id_[ordinal];
         matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
-    }
+    });
     return matched_documents;
 }
\ No newline at end of file
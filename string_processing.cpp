@@ -22,8 +22,11 @@ vector<string> SplitIntoWords(const string& text) {
     return words;
 }
 
-vector<string_view> SplitIntoWordsView(string_view str) {
-    vector<string_view> result;
+namespace {
+
+// appends the words of str to result, both std::vector and std::pmr::vector
+template <typename Words>
+void AppendWordViews(string_view str, Words& result) {
     int64_t pos = 0;
     const int64_t pos_end = str.npos;
     while (true) {
@@ -35,6 +38,18 @@ vector<string_view> SplitIntoWordsView(string_view str) {
             pos = space + 1;
         }
     }
+}
+
+}  // namespace
+
+vector<string_view> SplitIntoWordsView(string_view str) {
+    vector<string_view> result;
+    AppendWordViews(str, result);
+    return result;
+}
 
+pmr::vector<string_view> SplitIntoWordsView(string_view str, pmr::memory_resource* resource) {
+    pmr::vector<string_view> result(resource);
+    AppendWordViews(str, result);
     return result;
 }
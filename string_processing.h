@@ -2,6 +2,7 @@
 
 #include <string>
 #include <vector>
+#include <memory_resource>
 #include <set>
 
 
@@ -19,3 +20,4 @@ std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContain
 
 std::vector<std::string> SplitIntoWords(const std::string& text);
 std::vector<std::string_view> SplitIntoWordsView(std::string_view str);
+std::pmr::vector<std::string_view> SplitIntoWordsView(std::string_view str, std::pmr::memory_resource* resource);
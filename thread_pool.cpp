@@ -0,0 +1,49 @@
+#include "thread_pool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    if (thread_count == 0) {
+        thread_count = max(1u, thread::hardware_concurrency());
+    }
+    workers_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers_.emplace_back([this] {
+            WorkerLoop();
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard guard(mutex_);
+        stopping_ = true;
+    }
+    has_task_.notify_all();
+    for (thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::GetThreadCount() const {
+    return workers_.size();
+}
+
+void ThreadPool::WorkerLoop() {
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock lock(mutex_);
+            has_task_.wait(lock, [this] {
+                return stopping_ || !tasks_.empty();
+            });
+            // pending tasks are drained before exit so that no future is left broken
+            if (tasks_.empty()) {
+                return;
+            }
+            task = move(tasks_.front());
+            tasks_.pop();
+        }
+        task();
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t thread_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <typename Task>
+    std::future<std::invoke_result_t<std::decay_t<Task>>> Submit(Task&& task);
+
+    size_t GetThreadCount() const;
+
+private:
+    void WorkerLoop();
+
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable has_task_;
+    bool stopping_ = false;
+};
+
+template <typename Task>
+std::future<std::invoke_result_t<std::decay_t<Task>>> ThreadPool::Submit(Task&& task) {
+    using Result = std::invoke_result_t<std::decay_t<Task>>;
+
+    // std::function needs a copyable target, so the move-only packaged_task is shared
+    auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+    std::future<Result> result = packaged->get_future();
+    {
+        std::lock_guard guard(mutex_);
+        tasks_.emplace([packaged] {
+            (*packaged)();
+        });
+    }
+    has_task_.notify_one();
+    return result;
+}